@@ -0,0 +1,272 @@
+
+#pragma once
+
+#include <chess/common/number_types.hpp>
+#include <chess/common/assert.hpp>
+#include <chess/engine/base.hpp>
+#include <chess/engine/Bitboard.hpp>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHESS_PEXT_AVAILABLE 1
+#else
+#define CHESS_PEXT_AVAILABLE 0
+#endif
+
+namespace chess { namespace engine {
+    // #region Direction
+    enum class Direction : U8 {
+        North, NorthEast, East, SouthEast, South, SouthWest, West, NorthWest
+    };
+
+    inline constexpr U8 direction_count = 8;
+
+    inline constexpr Bitboard move_in_direction(Bitboard bitboard, Direction direction) {
+        if (direction == Direction::North) {
+            return move_north(bitboard);
+        } else if (direction == Direction::NorthEast) {
+            return move_north_east(bitboard) & ~bitboard_file[U8(File::A)];
+        } else if (direction == Direction::East) {
+            return move_east(bitboard) & ~bitboard_file[U8(File::A)];
+        } else if (direction == Direction::SouthEast) {
+            return move_south_east(bitboard) & ~bitboard_file[U8(File::A)];
+        } else if (direction == Direction::South) {
+            return move_south(bitboard);
+        } else if (direction == Direction::SouthWest) {
+            return move_south_west(bitboard) & ~bitboard_file[U8(File::H)];
+        } else if (direction == Direction::West) {
+            return move_west(bitboard) & ~bitboard_file[U8(File::H)];
+        } else {
+            return move_north_west(bitboard) & ~bitboard_file[U8(File::H)];
+        }
+    }
+
+    // all cells reached by sliding from bitboard in direction, stopping at (and including) the first cell in occupancy
+    inline constexpr Bitboard slide_in_direction(Bitboard bitboard, Direction direction, Bitboard occupancy) {
+        Bitboard result;
+        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
+            bitboard = move_in_direction(bitboard, direction);
+            result |= bitboard;
+            bitboard &= ~occupancy;
+        }
+        return result;
+    }
+
+    struct RayTable {
+        constexpr RayTable() noexcept
+            : data{}
+        {
+            for (U8 direction = 0; direction < direction_count; ++direction) {
+                for (U8 index = 0; index < chess_board_size; ++index) {
+                    data[direction][index] = slide_in_direction(Bitboard(Bitboard::Index(index)), Direction(direction), Bitboard());
+                }
+            }
+        }
+
+        Bitboard data[direction_count][chess_board_size];
+    };
+
+    inline constexpr RayTable ray_table;
+
+    inline constexpr Bitboard get_ray(Bitboard::Index index, Direction direction) {
+        return ray_table.data[U8(direction)][index.data];
+    }
+
+    struct LineTable {
+        constexpr LineTable() noexcept
+            : line{}
+            , between{}
+        {
+            for (U8 a = 0; a < chess_board_size; ++a) {
+                for (U8 direction = 0; direction < direction_count; ++direction) {
+                    const Bitboard ray = ray_table.data[direction][a];
+                    const Bitboard full_line = ray | ray_table.data[(direction + direction_count / 2) % direction_count][a] | Bitboard(Bitboard::Index(a));
+                    for (U8 b = 0; b < chess_board_size; ++b) {
+                        if (ray & Bitboard(Bitboard::Index(b))) {
+                            line[a][b] = full_line;
+                            between[a][b] = ray & ~ray_table.data[direction][b] & ~Bitboard(Bitboard::Index(b));
+                        }
+                    }
+                }
+            }
+        }
+
+        Bitboard line[chess_board_size][chess_board_size];
+        Bitboard between[chess_board_size][chess_board_size];
+    };
+
+    inline constexpr LineTable line_table;
+
+    // the whole line (edge to edge) through a and b, empty if they do not share a rank, file or diagonal
+    inline constexpr Bitboard get_line(Bitboard::Index a, Bitboard::Index b) {
+        return line_table.line[a.data][b.data];
+    }
+
+    // the cells strictly between a and b, empty if they do not share a rank, file or diagonal
+    inline constexpr Bitboard get_between(Bitboard::Index a, Bitboard::Index b) {
+        return line_table.between[a.data][b.data];
+    }
+    // #endregion
+
+    // #region knight, king and pawn attacks
+    // set-wise, all cells attacked by any of the pieces in bitboard
+    inline constexpr Bitboard get_knight_attacks(Bitboard bitboard) {
+        return (
+            (
+                (move_north(move_north_east(bitboard)) | move_south(move_south_east(bitboard)))
+                & ~bitboard_file[U8(File::A)]
+            ) | (
+                (move_east(move_north_east(bitboard)) | move_east(move_south_east(bitboard)))
+                & ~(bitboard_file[U8(File::A)] | bitboard_file[U8(File::B)])
+            ) | (
+                (move_north(move_north_west(bitboard)) | move_south(move_south_west(bitboard)))
+                & ~bitboard_file[U8(File::H)]
+            ) | (
+                (move_west(move_north_west(bitboard)) | move_west(move_south_west(bitboard)))
+                & ~(bitboard_file[U8(File::H)] | bitboard_file[U8(File::G)])
+            )
+        );
+    }
+
+    inline constexpr Bitboard get_king_attacks(Bitboard bitboard) {
+        return (
+            ((move_north_east(bitboard) | move_east(bitboard) | move_south_east(bitboard)) & ~bitboard_file[U8(File::A)])
+            | ((move_north_west(bitboard) | move_west(bitboard) | move_south_west(bitboard)) & ~bitboard_file[U8(File::H)])
+            | move_north(bitboard)
+            | move_south(bitboard)
+        );
+    }
+
+    template <Colour colour>
+    inline constexpr Bitboard get_pawn_attacks(Bitboard bitboard) {
+        return (move_forward<colour>(move_east(bitboard)) & ~bitboard_file[U8(File::A)]) | (move_forward<colour>(move_west(bitboard)) & ~bitboard_file[U8(File::H)]);
+    }
+
+    struct LeaperAttackTable {
+        constexpr LeaperAttackTable() noexcept
+            : knight{}
+            , king{}
+            , pawn{}
+        {
+            for (U8 index = 0; index < chess_board_size; ++index) {
+                const Bitboard bitboard(Bitboard::Index{index});
+                knight[index] = get_knight_attacks(bitboard);
+                king[index] = get_king_attacks(bitboard);
+                pawn[U8(Colour::White)][index] = get_pawn_attacks<Colour::White>(bitboard);
+                pawn[U8(Colour::Black)][index] = get_pawn_attacks<Colour::Black>(bitboard);
+            }
+        }
+
+        Bitboard knight[chess_board_size];
+        Bitboard king[chess_board_size];
+        Bitboard pawn[2][chess_board_size];
+    };
+
+    inline constexpr LeaperAttackTable leaper_attack_table;
+
+    // single piece, a table lookup
+    inline constexpr Bitboard get_knight_attacks(Bitboard::Index index) {
+        return leaper_attack_table.knight[index.data];
+    }
+
+    inline constexpr Bitboard get_king_attacks(Bitboard::Index index) {
+        return leaper_attack_table.king[index.data];
+    }
+
+    template <Colour colour>
+    inline constexpr Bitboard get_pawn_attacks(Bitboard::Index index) {
+        return leaper_attack_table.pawn[U8(colour)][index.data];
+    }
+    // #endregion
+
+    // #region sliding piece attacks
+    enum class SliderBackend : U8 {
+        // walk each ray one cell at a time, the original implementation, kept for comparison
+        Loop,
+        // magic bitboard attack table lookup
+        Magic,
+        // BMI2 PEXT indexed attack table lookup, only selectable on x86-64 cpus with a fast PEXT instruction
+        Pext
+    };
+
+    struct SliderAttackEntry {
+        Bitboard mask;
+        U64 magic;
+        const Bitboard* magic_attacks;
+        const Bitboard* pext_attacks;
+        U8 shift;
+    };
+
+    extern SliderAttackEntry bishop_attack_entries[chess_board_size];
+    extern SliderAttackEntry rook_attack_entries[chess_board_size];
+    // chosen at startup, Pext if the cpu has a fast PEXT instruction, otherwise Magic
+    extern SliderBackend slider_backend;
+
+    // fills the slider attack tables on the first call, Game's constructor calls it so a Game can be made during static
+    // initialisation
+    extern void init_attack_tables();
+    extern bool is_slider_backend_supported(SliderBackend backend);
+    // returns false, leaving the backend unchanged, if backend is not supported on this cpu
+    extern bool set_slider_backend(SliderBackend backend);
+    inline SliderBackend get_slider_backend();
+    inline Bitboard get_bishop_attacks(Bitboard::Index index, Bitboard occupancy);
+    inline Bitboard get_rook_attacks(Bitboard::Index index, Bitboard occupancy);
+    inline Bitboard get_queen_attacks(Bitboard::Index index, Bitboard occupancy);
+
+    inline SliderBackend get_slider_backend() {
+        return slider_backend;
+    }
+
+#if CHESS_PEXT_AVAILABLE
+    // inline assembly rather than the _pext_u64 intrinsic so that the engine does not need to be compiled with -mbmi2,
+    // only call this after checking that the cpu supports it
+    inline U64 parallel_bits_extract(U64 x, U64 mask) {
+        U64 result;
+        __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(x), "r"(mask));
+        return result;
+    }
+#endif
+
+    inline Bitboard get_bishop_attacks_loop(Bitboard::Index index, Bitboard occupancy) {
+        const Bitboard bitboard(index);
+        return slide_in_direction(bitboard, Direction::NorthEast, occupancy) | slide_in_direction(bitboard, Direction::SouthEast, occupancy)
+            | slide_in_direction(bitboard, Direction::SouthWest, occupancy) | slide_in_direction(bitboard, Direction::NorthWest, occupancy);
+    }
+
+    inline Bitboard get_rook_attacks_loop(Bitboard::Index index, Bitboard occupancy) {
+        const Bitboard bitboard(index);
+        return slide_in_direction(bitboard, Direction::North, occupancy) | slide_in_direction(bitboard, Direction::East, occupancy)
+            | slide_in_direction(bitboard, Direction::South, occupancy) | slide_in_direction(bitboard, Direction::West, occupancy);
+    }
+
+    // the one place the backend is chosen, every bishop, rook and queen attack in the engine is looked up through here
+    template <bool bishop>
+    inline Bitboard get_slider_attacks(Bitboard::Index index, Bitboard occupancy) {
+        CHESS_ASSERT(index < chess_board_size);
+        const SliderAttackEntry* entry = bishop ? &bishop_attack_entries[index.data] : &rook_attack_entries[index.data];
+        const SliderBackend backend = slider_backend;
+#if CHESS_PEXT_AVAILABLE
+        if (backend == SliderBackend::Pext) {
+            return entry->pext_attacks[parallel_bits_extract(occupancy.data, entry->mask.data)];
+        }
+#endif
+
+        if (backend == SliderBackend::Magic) {
+            return entry->magic_attacks[((occupancy & entry->mask).data * entry->magic) >> entry->shift];
+        }
+
+        return bishop ? get_bishop_attacks_loop(index, occupancy) : get_rook_attacks_loop(index, occupancy);
+    }
+
+    inline Bitboard get_bishop_attacks(Bitboard::Index index, Bitboard occupancy) {
+        return get_slider_attacks<true>(index, occupancy);
+    }
+
+    inline Bitboard get_rook_attacks(Bitboard::Index index, Bitboard occupancy) {
+        return get_slider_attacks<false>(index, occupancy);
+    }
+
+    inline Bitboard get_queen_attacks(Bitboard::Index index, Bitboard occupancy) {
+        return get_bishop_attacks(index, occupancy) | get_rook_attacks(index, occupancy);
+    }
+    // #endregion
+}}
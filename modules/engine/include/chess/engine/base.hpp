@@ -128,6 +128,14 @@ namespace chess { namespace engine {
         {}
     };
 
+    // the number of piece types, excluding Empty
+    inline constexpr U8 piece_type_count = 6;
+
+    // pawn is 0, king is 5, for arrays indexed by piece type
+    inline constexpr U8 get_piece_type_index(Piece::Type type) {
+        return U8(type) - U8(Piece::Type::Pawn);
+    }
+
     inline constexpr char char_promotion_piece_type(Piece::Type x) {
         if (x == Piece::Type::Knight) {
             return 'n';
@@ -5,6 +5,10 @@
 #include <chess/common/assert.hpp>
 #include <chess/engine/base.hpp>
 #include <chess/engine/Bitboard.hpp>
+#include <chess/engine/attacks.hpp>
+#include <chess/engine/zobrist.hpp>
+#include <atomic>
+#include <cstddef>
 
 /*
 
@@ -50,37 +54,75 @@ namespace chess { namespace engine {
         Bitboard west_skewer;
         Bitboard north_west_skewer;
         Bitboard check_resolution_bitboard;
+        // friendly pieces that are the only piece between the king and an enemy slider
+        Bitboard pinned;
+        // cells attacked by the enemy, with enemy sliders seeing through the friendly king, so it can not step back
+        // along a checking line
+        Bitboard enemy_attacks;
         bool single_check : 1;
         bool double_check : 1;
         bool has_moves : 1;
     };
 
+    // what the side to move needs to tell whether one of its moves gives check, without making it
+    struct CheckSquares {
+        Bitboard::Index enemy_king_index;
+        // cells from which a piece of that type attacks the enemy king
+        Bitboard pawn;
+        Bitboard knight;
+        Bitboard bishop;
+        Bitboard rook;
+        // friendly pieces that are the only piece between the enemy king and a friendly slider
+        Bitboard discoverers;
+    };
+
     enum class CastleDirection {
         Short, Long
     };
 
-    // #region CompressedTakenAndPromotionPieceType
-    struct CompressedTakenAndPromotionPieceType {
-        constexpr CompressedTakenAndPromotionPieceType() noexcept : data(0) {}
-        constexpr CompressedTakenAndPromotionPieceType(Piece::Type taken_piece, Piece::Type promotion_piece) noexcept : data((U8(promotion_piece) << 4) | U8(taken_piece)) {}
+    // #region Move
+    // from in bits 0-5, to in bits 6-11, the promotion piece in bits 12-13 and the flag in bits 14-15,
+    // small enough for move lists and the move history to stay cheap to copy
+    struct Move {
+        enum class Flag : U8 {
+            None, Promotion, EnPassant, Castle
+        };
 
-        U8 data;
+        constexpr Move() noexcept : data(0) {}
+        constexpr Move(Bitboard::Index from, Bitboard::Index to, Flag flag = Flag::None) noexcept
+            : data(U16(from.data | (to.data << 6) | (U8(flag) << 14)))
+        {}
+        // promotion_piece_type is one of knight, bishop, rook or queen
+        constexpr Move(Bitboard::Index from, Bitboard::Index to, Piece::Type promotion_piece_type) noexcept
+            : data(U16(from.data | (to.data << 6) | ((U8(promotion_piece_type) - U8(Piece::Type::Knight)) << 12) | (U8(Flag::Promotion) << 14)))
+        {}
+
+        U16 data;
     };
 
-    inline void set_taken_piece_type(CompressedTakenAndPromotionPieceType* x, Piece::Type taken_piece) {
-        x->data = (x->data & (0b1111 << 4)) | U8(taken_piece);
+    inline constexpr Bitboard::Index get_from(Move move) {
+        return Bitboard::Index(U8(move.data & 0b111111));
+    }
+
+    inline constexpr Bitboard::Index get_to(Move move) {
+        return Bitboard::Index(U8((move.data >> 6) & 0b111111));
     }
 
-    inline void set_promotion_piece_type(CompressedTakenAndPromotionPieceType* x, Piece::Type taken_piece) {
-        x->data = (x->data & 0b1111) | (U8(taken_piece) << 4);
+    inline constexpr Move::Flag get_flag(Move move) {
+        return Move::Flag(move.data >> 14);
     }
 
-    inline constexpr Piece::Type get_taken_piece_type(CompressedTakenAndPromotionPieceType x) {
-        return Piece::Type(x.data & 0b1111);
+    // Empty for non promotions
+    inline constexpr Piece::Type get_promotion_piece_type(Move move) {
+        if (get_flag(move) != Move::Flag::Promotion) {
+            return Piece::Type::Empty;
+        }
+
+        return Piece::Type(U8(Piece::Type::Knight) + ((move.data >> 12) & 0b11));
     }
 
-    inline constexpr Piece::Type get_promotion_piece_type(CompressedTakenAndPromotionPieceType x) {
-        return Piece::Type(x.data >> 4);
+    inline constexpr bool operator==(Move a, Move b) {
+        return a.data == b.data;
     }
     // #endregion
 
@@ -110,10 +152,98 @@ namespace chess { namespace engine {
         }
     };
 
+    // #region MoveList
+    // no legal chess position has more than 218 moves
+    inline constexpr U16 move_list_capacity = 256;
+
+    struct MoveList {
+        constexpr MoveList() noexcept
+            : count(0)
+        {}
+
+        Move moves[move_list_capacity];
+        U16 count;
+    };
+    // #endregion
+
+    // #region PerftTable
+    // shared between perft threads without locks, key is stored xor'd with data so that an entry torn by two
+    // threads writing at once fails validation instead of returning another position's count
+    struct PerftTableEntry {
+        std::atomic<U64> key_xor_data;
+        // node count in the high 56 bits, remaining depth in the low 8 bits, 0 if the entry is empty
+        std::atomic<U64> data;
+    };
+
+    inline constexpr U8 perft_table_bucket_size = 4;
+    // larger sizes are clamped to this, 1TB
+    inline constexpr U64 perft_table_max_megabytes = U64(1) << 20;
+
+    // one cache line
+    struct alignas(64) PerftTableBucket {
+        PerftTableEntry entries[perft_table_bucket_size];
+    };
+
+    // maps (position key, remaining depth) to a node count
+    struct PerftTable {
+        // rounded down to a power of two number of buckets, halved until the allocation succeeds, buckets is nullptr
+        // and bucket_count 0 if not even one bucket could be allocated
+        explicit PerftTable(U64 size_in_megabytes);
+        PerftTable(const PerftTable&) = delete;
+        PerftTable& operator=(const PerftTable&) = delete;
+        ~PerftTable();
+
+        PerftTableBucket* buckets;
+        U64 bucket_count;
+    };
+    // #endregion
+
+    // how a search takes back the moves it makes
+    enum class UndoMode : U8 {
+        // unperform the move from its undo record
+        MakeUnmake,
+        // copy the position before making moves from it, and copy it back to undo each one
+        CopyMake
+    };
+
+    // #region PerftThreadPool
+    struct PerftThreadPoolState;
+
+    // persistent worker threads for fast_perft_multi_threaded, each with its own deque of subtrees,
+    // a worker that runs dry steals from the others and busy workers split their subtrees further
+    struct PerftThreadPool {
+        // 0 starts one thread per hardware thread
+        explicit PerftThreadPool(U32 thread_count = 0);
+        PerftThreadPool(const PerftThreadPool&) = delete;
+        PerftThreadPool& operator=(const PerftThreadPool&) = delete;
+        ~PerftThreadPool();
+
+        U32 thread_count;
+        PerftThreadPoolState* state;
+    };
+    // #endregion
+
     // #region Game
-    struct Move;
+    // the state a move can not be reversed without, recorded alongside each move in the history
+    struct UndoRecord {
+        Piece::Type taken_piece_type;
+        Bitboard::Index en_passant_cell;
+        bool can_en_passant : 1;
+        bool white_can_never_castle_short : 1;
+        bool white_can_never_castle_long : 1;
+        bool black_can_never_castle_short : 1;
+        bool black_can_never_castle_long : 1;
+    };
 
-    inline constexpr const U8 check_data_capacity = 16;
+    // everything about a ply of the history that undo and redo would otherwise have to recompute
+    struct PlyState {
+        // check data, and the enemy attack map, of the position at this ply
+        CheckData check_data;
+        // zobrist key of the position at this ply
+        U64 key;
+        // the undo record of the move made from this ply, if there is one
+        UndoRecord undo_record;
+    };
 
     struct CompressedBoard {
         enum class Piece {
@@ -129,76 +259,54 @@ namespace chess { namespace engine {
         U8 flags;
     };
 
-    struct Game {
+    // the move history and the move cache, the cold side of a Game, allocated with it
+    struct ColdState {
+        U64 moves_index;
+        U64 moves_count;
+        U64 moves_allocated;
+        Move* moves;
+        // plies[i] is the state of the position after i moves, kept for the whole history, grown along with moves
+        PlyState* plies;
+
+        alignas(64) Cache cache;
+    };
+
+    // the position, everything make, unmake and move generation read and write of a Game itself, fills the first two
+    // cache lines, the history and the move cache are behind cold
+    struct alignas(64) Game {
         Game();
         ~Game();
 
-        Bitboard white_pawns;
-        Bitboard white_knights;
-        Bitboard white_bishops;
-        Bitboard white_rooks;
-        Bitboard white_queens;
-        Bitboard white_kings;
-        Bitboard black_pawns;
-        Bitboard black_knights;
-        Bitboard black_bishops;
-        Bitboard black_rooks;
-        Bitboard black_queens;
-        Bitboard black_kings;
-        mutable Cache cache;
+        // indexed by colour then get_piece_type_index
+        Bitboard pieces[2][piece_type_count];
+        // every piece of each colour, kept in step with pieces, get_all_pieces ors the two
+        Bitboard colour_pieces[2];
+        // zobrist key of the position, updated incrementally as moves are made and undone
+        U64 key;
         Bitboard::Index en_passant_cell;
-        U64 moves_allocated;
-        U64 moves_count;
-        U64 moves_index;
-        Move* moves;
-        U8 check_data_head;
-        U8 check_data_index;
-        CheckData check_data[check_data_capacity];
         bool can_en_passant : 1;
         bool next_turn : 1;
         bool white_can_never_castle_short : 1;
         bool white_can_never_castle_long : 1;
         bool black_can_never_castle_short : 1;
         bool black_can_never_castle_long : 1;
-    };
 
-    struct Move {
-        Move(const Game* game, Bitboard::Index in_from, Bitboard::Index in_to) noexcept
-            : from(in_from)
-            , to(in_to)
-            , compressed_taken_and_promotion_piece_type(CompressedTakenAndPromotionPieceType())
-            // TODO(TB): set in_check correctly
-            , in_check(false)
-            , white_can_never_castle_short(game->white_can_never_castle_short)
-            , white_can_never_castle_long(game->white_can_never_castle_long)
-            , black_can_never_castle_short(game->black_can_never_castle_short)
-            , black_can_never_castle_long(game->black_can_never_castle_long)
-            , can_en_passant(game->can_en_passant)
-        {}
+        ColdState* cold;
+    };
 
-        Move(const Game* game, Bitboard::Index in_from, Bitboard::Index in_to, Piece::Type promotion_piece_type) noexcept
-            : from(in_from)
-            , to(in_to)
-            , compressed_taken_and_promotion_piece_type(Piece::Type::Empty, promotion_piece_type)
-            // TODO(TB): set in_check correctly
-            , in_check(false)
-            , white_can_never_castle_short(game->white_can_never_castle_short)
-            , white_can_never_castle_long(game->white_can_never_castle_long)
-            , black_can_never_castle_short(game->black_can_never_castle_short)
-            , black_can_never_castle_long(game->black_can_never_castle_long)
-            , can_en_passant(game->can_en_passant)
-        {}
+    static_assert(offsetof(Game, cold) <= 128, "the position should fit in the first two cache lines");
 
-        Bitboard::Index from;
-        Bitboard::Index to;
-        // taken piece type is filled in by function move
-        CompressedTakenAndPromotionPieceType compressed_taken_and_promotion_piece_type;
-        bool in_check : 1;
+    // the part of a Game needed to search from it, without the move history or caches, cheap to pass between threads
+    struct Position {
+        Bitboard pieces[2][piece_type_count];
+        U64 key;
+        Bitboard::Index en_passant_cell;
+        bool can_en_passant : 1;
+        bool next_turn : 1;
         bool white_can_never_castle_short : 1;
         bool white_can_never_castle_long : 1;
         bool black_can_never_castle_short : 1;
         bool black_can_never_castle_long : 1;
-        bool can_en_passant : 1;
     };
 
     template <Colour colour>
@@ -219,6 +327,8 @@ namespace chess { namespace engine {
     inline bool is_empty(const Game* game, Bitboard bitboard);
     inline bool is_empty(const Game* game, Bitboard bitboard);
     extern Piece get_piece(const Game* game, Bitboard bitboard);
+    // the zobrist key of the position computed from scratch, game->key should always equal this
+    extern U64 calculate_key(const Game* game);
     template <Colour colour>
     extern Piece::Type get_friendly_piece_type(const Game* game, Bitboard bitboard);
     template <Colour colour>
@@ -247,6 +357,7 @@ namespace chess { namespace engine {
     inline Bitboard* get_friendly_kings(Game* game);
     template <Colour colour, bool exclude_king = false>
     inline Bitboard get_friendly_pieces(const Game* game);
+    inline Bitboard get_all_pieces(const Game* game);
     extern Bitboard get_cells_moved_from(const Game* game);
     extern Bitboard get_cells_moved_to(const Game* game);
     template <Colour colour>
@@ -254,6 +365,8 @@ namespace chess { namespace engine {
     template <Colour colour>
     extern Bitboard* get_friendly_bitboard(Game* game, Bitboard bitboard);
     extern Bitboard get_moves(Game* game, Bitboard::Index index);
+    // writes every legal move for the side to move into move_list, with promotions expanded to one move per piece type
+    extern void generate_legal_moves(Game* game, MoveList* move_list);
     extern bool move(Game* game, Bitboard::Index from, Bitboard::Index to);
     extern bool move_and_promote(Game* game, Bitboard::Index from, Bitboard::Index to, Piece::Type promotion_piece);
     inline bool can_undo(const Game* game);
@@ -263,20 +376,31 @@ namespace chess { namespace engine {
     extern bool load_fen(Game* game, const char* fen);
     template <bool divided = false>
     extern PerftResult perft(Game* game, U8 depth);
+    // perft split between the threads of pool, see fast_perft_multi_threaded
     template <bool divided = false>
-    extern U64 fast_perft(Game* game, U8 depth);
-    template <bool divided = false>
-    extern U64 fast_perft_multi_threaded(Game* game, U8 depth);
+    extern PerftResult perft_multi_threaded(Game* game, U8 depth, PerftThreadPool* pool = nullptr);
+    // bulk_count counts the moves at depth 1 with popcount over the legal move bitboards rather than generating each one
+    // table, if given, caches the node count of every position searched with depth 2 or more
+    template <bool divided = false, bool bulk_count = false, UndoMode undo_mode = UndoMode::MakeUnmake>
+    extern U64 fast_perft(Game* game, U8 depth, PerftTable* table = nullptr);
+    extern void clear_perft_table(PerftTable* table);
+    // pool defaults to one shared by every caller, with a thread per hardware thread
+    template <bool divided = false, bool bulk_count = false, UndoMode undo_mode = UndoMode::MakeUnmake>
+    extern U64 fast_perft_multi_threaded(Game* game, U8 depth, PerftTable* table = nullptr, PerftThreadPool* pool = nullptr);
     extern void string_move(Move move, char* buffer);
     extern bool make_moves(Game* game, const char* moves);
     inline const CheckData* get_check_data(const Game* game);
     inline CheckData* get_check_data(Game* game);
-    // returns true if data is reused
-    inline bool next_check_data(Game* game);
-    // returns true if data is reused
-    inline bool previous_check_data(Game* game);
     extern void print_board(const Game* game);
     extern Game* copy(Game* game);
+    extern Position get_position(const Game* game);
+    // for the side to move, reusable for every move from the position
+    extern CheckSquares get_check_squares(const Game* game);
+    // whether a legal move of the side to move gives check, including promotions, en passant and castling
+    extern bool gives_check(const Game* game, const CheckSquares* check_squares, Move move);
+    extern bool gives_check(const Game* game, Move move);
+    // replaces the position of game, clearing its move history, without allocating
+    extern void set_position(Game* game, const Position* position);
 
     template <Colour colour>
     inline bool has_friendly_piece(const Game* game, Bitboard bitboard) {
@@ -329,11 +453,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_pawns(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_pawns;
-        } else {
-            return &game->white_pawns;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::Pawn)];
     }
 
     template <Colour colour>
@@ -343,11 +463,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_knights(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_knights;
-        } else {
-            return &game->white_knights;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::Knight)];
     }
 
     template <Colour colour>
@@ -357,11 +473,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_bishops(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_bishops;
-        } else {
-            return &game->white_bishops;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::Bishop)];
     }
 
     template <Colour colour>
@@ -371,11 +483,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_rooks(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_rooks;
-        } else {
-            return &game->white_rooks;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::Rook)];
     }
 
     template <Colour colour>
@@ -385,11 +493,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_queens(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_queens;
-        } else {
-            return &game->white_queens;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::Queen)];
     }
 
     template <Colour colour>
@@ -399,11 +503,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     inline const Bitboard* get_friendly_kings(const Game* game) {
-        if constexpr (colour == Colour::Black) {
-            return &game->black_kings;
-        } else {
-            return &game->white_kings;
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(Piece::Type::King)];
     }
 
     template <Colour colour>
@@ -414,57 +514,30 @@ namespace chess { namespace engine {
     template <Colour colour, bool exclude_king>
     inline Bitboard get_friendly_pieces(const Game* game) {
         if constexpr (exclude_king) {
-            return *get_friendly_pawns<colour>(game) | *get_friendly_knights<colour>(game)
-                | *get_friendly_bishops<colour>(game) | *get_friendly_rooks<colour>(game)
-                | *get_friendly_queens<colour>(game);
+            return game->colour_pieces[U8(colour)] & ~*get_friendly_kings<colour>(game);
         } else {
-            return *get_friendly_pawns<colour>(game) | *get_friendly_knights<colour>(game)
-                | *get_friendly_bishops<colour>(game) | *get_friendly_rooks<colour>(game)
-                | *get_friendly_queens<colour>(game) | *get_friendly_kings<colour>(game);
+            return game->colour_pieces[U8(colour)];
         }
     }
 
+    inline Bitboard get_all_pieces(const Game* game) {
+        return game->colour_pieces[U8(Colour::White)] | game->colour_pieces[U8(Colour::Black)];
+    }
+
     inline bool can_undo(const Game* game) {
-        return game->moves_index != 0;
+        return game->cold->moves_index != 0;
     }
 
     inline bool can_redo(const Game* game) {
-        return game->moves_index < game->moves_count;
+        return game->cold->moves_index < game->cold->moves_count;
     }
 
     inline const CheckData* get_check_data(const Game* game) {
-        return &game->check_data[game->check_data_index];
+        return &game->cold->plies[game->cold->moves_index].check_data;
     }
 
     inline CheckData* get_check_data(Game* game) {
-        return &game->check_data[game->check_data_index];
-    }
-
-    inline bool next_check_data(Game* game) {
-        CHESS_ASSERT(game->check_data_index < check_data_capacity);
-        game->check_data_index = static_cast<U8>(game->check_data_index + 1) % check_data_capacity;
-        if (game->check_data_index == game->check_data_head) {
-            game->check_data_head = static_cast<U8>(game->check_data_head + 1) % check_data_capacity;
-            CHESS_ASSERT(game->check_data_index < check_data_capacity);
-            return false;
-        }
-
-        CHESS_ASSERT(game->check_data_index < check_data_capacity);
-        return true;
-    }
-
-    inline bool previous_check_data(Game* game) {
-        CHESS_ASSERT(game->check_data_index < check_data_capacity);
-        if (game->check_data_index == game->check_data_head) {
-            game->check_data_index = static_cast<U8>(game->check_data_index - 1) % check_data_capacity;
-            game->check_data_head = game->check_data_index;
-            CHESS_ASSERT(game->check_data_index < check_data_capacity);
-            return false;
-        }
-
-        game->check_data_index = static_cast<U8>(game->check_data_index - 1) % check_data_capacity;
-        CHESS_ASSERT(game->check_data_index < check_data_capacity);
-        return true;
+        return &game->cold->plies[game->cold->moves_index].check_data;
     }
     // #endregion
 }}
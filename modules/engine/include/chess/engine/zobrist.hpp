@@ -0,0 +1,76 @@
+
+#pragma once
+
+#include <chess/common/number_types.hpp>
+#include <chess/engine/base.hpp>
+#include <chess/engine/Bitboard.hpp>
+
+namespace chess { namespace engine {
+    // #region Zobrist keys
+    enum class CastleRight : U8 {
+        WhiteShort, WhiteLong, BlackShort, BlackLong
+    };
+
+    inline constexpr U8 castle_right_count = 4;
+
+    struct ZobristTable {
+        constexpr ZobristTable() noexcept
+            : piece{}
+            , castle_right{}
+            , en_passant_file{}
+            , black_to_move(0)
+        {
+            // splitmix64, any fixed seed will do as long as the keys never change between runs
+            U64 state = 0x2545F4914F6CDD1DULL;
+            auto next = [&state]() {
+                state += 0x9E3779B97F4A7C15ULL;
+                U64 z = state;
+                z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+                return z ^ (z >> 31);
+            };
+
+            for (U8 colour = 0; colour < 2; ++colour) {
+                for (U8 type = 0; type < piece_type_count; ++type) {
+                    for (U8 index = 0; index < chess_board_size; ++index) {
+                        piece[colour][type][index] = next();
+                    }
+                }
+            }
+
+            for (U8 i = 0; i < castle_right_count; ++i) {
+                castle_right[i] = next();
+            }
+
+            for (U8 i = 0; i < chess_board_edge_size; ++i) {
+                en_passant_file[i] = next();
+            }
+
+            black_to_move = next();
+        }
+
+        U64 piece[2][piece_type_count][chess_board_size];
+        U64 castle_right[castle_right_count];
+        U64 en_passant_file[chess_board_edge_size];
+        U64 black_to_move;
+    };
+
+    inline constexpr ZobristTable zobrist_table;
+
+    inline constexpr U64 get_piece_key(Colour colour, Piece::Type type, Bitboard::Index index) {
+        return zobrist_table.piece[U8(colour)][get_piece_type_index(type)][index.data];
+    }
+
+    inline constexpr U64 get_castle_right_key(CastleRight castle_right) {
+        return zobrist_table.castle_right[U8(castle_right)];
+    }
+
+    inline constexpr U64 get_en_passant_key(Bitboard::Index en_passant_cell) {
+        return zobrist_table.en_passant_file[en_passant_cell.data % chess_board_edge_size];
+    }
+
+    inline constexpr U64 get_black_to_move_key() {
+        return zobrist_table.black_to_move;
+    }
+    // #endregion
+}}
@@ -2,84 +2,778 @@
 #include <chess/engine/engine.hpp>
 #include <iostream>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 namespace chess {
-    struct Timer {
-        Timer()
-            : start_time(std::chrono::high_resolution_clock::now())
-        {}
+    static constexpr U64 start_position_nodes[]{
+        1,
+        20,
+        400,
+        8902,
+        197281,
+        4865609,
+        119060324,
+        3195901860,
+        84998978956,
+        2439530234167,
+        69352859712417,
+        2097651003696806,
+        62854969236701747,
+        1981066775000396239
+    };
+
+    struct Options {
+        U8 depth = 7;
+        const char* fen = "";
+        const char* moves = "";
+        // 0 uses one thread per hardware thread
+        U32 threads = 1;
+        // the epd suite uses every hardware thread unless -t is given
+        bool threads_given = false;
+        U64 hash_megabytes = 0;
+        U32 repeat = 1;
+        // 0 when unknown, the start position counts are used when neither fen nor moves are given
+        U64 expected = 0;
+        bool divided = false;
+        bool detailed = false;
+        bool bulk_count = true;
+        bool copy_make = false;
+        bool json = false;
+        // reports the layout of the engine's structs, and the cache misses of each run
+        bool memory = false;
+        // runs every (position, depth) in the file instead of a single perft
+        const char* epd = nullptr;
+        U8 max_depth = 255;
+    };
+
+    struct Run {
+        engine::PerftResult result;
+        U64 microseconds;
+        U64 cache_misses;
+    };
+
+    struct DivideEntry {
+        char move_name[6];
+        U64 nodes;
+    };
+
+    static void print_usage() {
+        std::cout
+            << "usage: chess_engine_perft [options] [depth] [fen] [moves]\n"
+            << "  -d, --depth <n>       depth to search, default 7\n"
+            << "  -f, --fen <fen>       position to search from, default the initial position\n"
+            << "  -m, --moves <moves>   moves to make from the position first, e.g. \"e2e4 e7e5\"\n"
+            << "  -t, --threads <n>     worker threads, 0 for one per hardware thread, default 1\n"
+            << "      --hash <MB>       size of the transposition table, at most 1048576, default 0 (none)\n"
+            << "      --divide          print the node count under each root move, as \"divide\" with --json\n"
+            << "      --detailed        count captures, checks, etc. as well as nodes\n"
+            << "      --no-bulk         generate every leaf move rather than counting them\n"
+            << "      --copy-make       undo moves by copying the position back rather than unmaking them\n"
+            << "  -r, --repeat <n>      search n times, reporting each run, default 1\n"
+            << "  -e, --expected <n>    node count to check the result against\n"
+            << "      --json            print the results as a json object\n"
+            << "      --memory          print the size and layout of Game, and the cache misses per node of each run,\n"
+            << "                        counted over every search thread, and only where perf_event_open is allowed\n"
+            << "      --epd <file>      check every position and depth in a perft epd file, e.g. \"<fen> ;D1 20 ;D2 400\",\n"
+            << "                        running positions in parallel on --threads threads, default one per hardware thread\n"
+            << "      --max-depth <n>   skip the depths in the epd file deeper than this\n"
+            << "  -h, --help            print this message\n";
+    }
+
+    static bool is_white_space(const char* str) {
+        for (U64 i = 0; ; ++i) {
+            if (str[i] == '\0') {
+                return true;
+            }
+            if (str[i] != ' ') {
+                return false;
+            }
+        }
+    }
+
+    static bool parse_number(const char* str, U64* result) {
+        if (*str < '0' || *str > '9') {
+            return false;
+        }
+
+        char* end;
+        *result = strtoull(str, &end, 10);
+        return *end == '\0';
+    }
+
+    // returns false, after printing why, if the arguments are invalid
+    static bool parse_options(int argc, char* argv[], Options* options, bool* help) {
+        U32 positional_count = 0;
+        for (int i = 1; i < argc; ++i) {
+            const char* arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            U64 number;
+
+            if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0) {
+                *help = true;
+                return true;
+            } else if (strcmp(arg, "--divide") == 0) {
+                options->divided = true;
+            } else if (strcmp(arg, "--detailed") == 0) {
+                options->detailed = true;
+            } else if (strcmp(arg, "--no-bulk") == 0) {
+                options->bulk_count = false;
+            } else if (strcmp(arg, "--copy-make") == 0) {
+                options->copy_make = true;
+            } else if (strcmp(arg, "--json") == 0) {
+                options->json = true;
+            } else if (strcmp(arg, "--memory") == 0) {
+                options->memory = true;
+            } else if (strcmp(arg, "--epd") == 0) {
+                if (!has_value) {
+                    std::cerr << "missing value for --epd" << std::endl;
+                    return false;
+                }
+                options->epd = argv[++i];
+            } else if (strcmp(arg, "--max-depth") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number) || number > 255) {
+                    std::cerr << "invalid max depth" << std::endl;
+                    return false;
+                }
+                options->max_depth = U8(number);
+            } else if ((strcmp(arg, "-f") == 0 || strcmp(arg, "--fen") == 0) && has_value) {
+                options->fen = argv[++i];
+            } else if ((strcmp(arg, "-m") == 0 || strcmp(arg, "--moves") == 0) && has_value) {
+                options->moves = argv[++i];
+            } else if (strcmp(arg, "-d") == 0 || strcmp(arg, "--depth") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number) || number > 255) {
+                    std::cerr << "invalid depth" << std::endl;
+                    return false;
+                }
+                options->depth = U8(number);
+            } else if (strcmp(arg, "-t") == 0 || strcmp(arg, "--threads") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number) || number > 4096) {
+                    std::cerr << "invalid thread count" << std::endl;
+                    return false;
+                }
+                options->threads = U32(number);
+                options->threads_given = true;
+            } else if (strcmp(arg, "--hash") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number) || number > engine::perft_table_max_megabytes) {
+                    std::cerr << "invalid hash size" << std::endl;
+                    return false;
+                }
+                options->hash_megabytes = number;
+            } else if (strcmp(arg, "-r") == 0 || strcmp(arg, "--repeat") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number) || number == 0 || number > 1000000) {
+                    std::cerr << "invalid repeat count" << std::endl;
+                    return false;
+                }
+                options->repeat = U32(number);
+            } else if (strcmp(arg, "-e") == 0 || strcmp(arg, "--expected") == 0) {
+                if (!has_value || !parse_number(argv[++i], &number)) {
+                    std::cerr << "invalid expected node count" << std::endl;
+                    return false;
+                }
+                options->expected = number;
+            } else if (arg[0] == '-' && arg[1] != '\0') {
+                std::cerr << "unknown option " << arg << std::endl;
+                return false;
+            } else if (is_white_space(arg)) {
+                // an empty positional argument leaves its default
+                ++positional_count;
+            } else {
+                // depth fen moves
+                if (positional_count == 0) {
+                    if (!parse_number(arg, &number) || number > 255) {
+                        std::cerr << "invalid depth" << std::endl;
+                        return false;
+                    }
+                    options->depth = U8(number);
+                } else if (positional_count == 1) {
+                    options->fen = arg;
+                } else if (positional_count == 2) {
+                    options->moves = arg;
+                } else {
+                    std::cerr << "unexpected argument " << arg << std::endl;
+                    return false;
+                }
+                ++positional_count;
+            }
+        }
+
+        if (options->expected == 0 && is_white_space(options->fen) && is_white_space(options->moves) && options->depth < sizeof(start_position_nodes) / sizeof(U64)) {
+            options->expected = start_position_nodes[options->depth];
+        }
+
+        return true;
+    }
+
+    template <bool divided, bool bulk_count, engine::UndoMode undo_mode>
+    static U64 run_fast_perft(engine::Game* game, U8 depth, engine::PerftTable* table, engine::PerftThreadPool* pool) {
+        if (pool) {
+            return engine::fast_perft_multi_threaded<divided, bulk_count, undo_mode>(game, depth, table, pool);
+        }
+
+        return engine::fast_perft<divided, bulk_count, undo_mode>(game, depth, table);
+    }
+
+    template <engine::UndoMode undo_mode>
+    static U64 run_fast_perft(engine::Game* game, const Options* options, engine::PerftTable* table, engine::PerftThreadPool* pool) {
+        if (options->divided) {
+            return options->bulk_count
+                ? run_fast_perft<true, true, undo_mode>(game, options->depth, table, pool)
+                : run_fast_perft<true, false, undo_mode>(game, options->depth, table, pool);
+        }
+
+        return options->bulk_count
+            ? run_fast_perft<false, true, undo_mode>(game, options->depth, table, pool)
+            : run_fast_perft<false, false, undo_mode>(game, options->depth, table, pool);
+    }
+
+    static engine::PerftResult run_perft(engine::Game* game, const Options* options, engine::PerftTable* table, engine::PerftThreadPool* pool) {
+        if (options->detailed) {
+            if (pool) {
+                return options->divided ? engine::perft_multi_threaded<true>(game, options->depth, pool) : engine::perft_multi_threaded<false>(game, options->depth, pool);
+            }
+            return options->divided ? engine::perft<true>(game, options->depth) : engine::perft<false>(game, options->depth);
+        }
+
+        engine::PerftResult result{};
+        if (options->copy_make) {
+            result.nodes = run_fast_perft<engine::UndoMode::CopyMake>(game, options, table, pool);
+        } else {
+            result.nodes = run_fast_perft<engine::UndoMode::MakeUnmake>(game, options, table, pool);
+        }
+        return result;
+    }
 
-        ~Timer() {
-            auto end_time = std::chrono::high_resolution_clock::now();
-            auto duration = std::chrono::time_point_cast<std::chrono::microseconds>(end_time).time_since_epoch().count()
-                - std::chrono::time_point_cast<std::chrono::microseconds>(start_time).time_since_epoch().count();
-            double ms = duration * 0.001;
-            std::cout << duration << "us (" << ms << "ms)" << std::endl;
+    // the engine prints its divide to stdout, which would break the json, so with --json each root move is searched here
+    // and its node count collected into divide instead
+    static engine::PerftResult run_divided_perft(engine::Game* game, const Options* options, engine::PerftTable* table, engine::PerftThreadPool* pool, std::vector<DivideEntry>* divide) {
+        divide->clear();
+        if (options->depth == 0) {
+            return run_perft(game, options, table, pool);
         }
 
-        std::chrono::time_point<std::chrono::high_resolution_clock> start_time;
+        Options move_options = *options;
+        move_options.depth = options->depth - 1;
+        move_options.divided = false;
+
+        engine::MoveList move_list;
+        engine::generate_legal_moves(game, &move_list);
+        engine::PerftResult result{};
+        for (U16 i = 0; i < move_list.count; ++i) {
+            DivideEntry entry;
+            engine::string_move(move_list.moves[i], entry.move_name);
+            const bool moved = engine::make_moves(game, entry.move_name);
+            CHESS_ASSERT(moved);
+            (void)moved;
+            const engine::PerftResult move_result = run_perft(game, &move_options, table, pool);
+            engine::undo(game);
+            entry.nodes = move_result.nodes;
+            divide->push_back(entry);
+            result = result + move_result;
+        }
+
+        return result;
+    }
+
+    // #region memory
+    // last level cache misses of the calling thread and of the threads it creates after opening the counter, e.g. the
+    // workers of a PerftThreadPool, from perf_event_open, which is linux only and can be refused by the kernel, see
+    // /proc/sys/kernel/perf_event_paranoid
+    struct CacheMissCounter {
+        int fd = -1;
     };
 
-    void perft(U8 depth, U64 expected) {
+    static bool open_cache_miss_counter(CacheMissCounter* counter) {
+#if defined(__linux__)
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // the ioctls and reads of fd then cover the inherited counters of the child threads too
+        attr.inherit = 1;
+        counter->fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        return counter->fd != -1;
+    }
+
+    static void close_cache_miss_counter(CacheMissCounter* counter) {
+#if defined(__linux__)
+        if (counter->fd != -1) {
+            close(counter->fd);
+        }
+#endif
+        counter->fd = -1;
+    }
+
+    static void start_cache_miss_counter(const CacheMissCounter* counter) {
+#if defined(__linux__)
+        ioctl(counter->fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(counter->fd, PERF_EVENT_IOC_ENABLE, 0);
+#else
+        (void)counter;
+#endif
+    }
+
+    static U64 stop_cache_miss_counter(const CacheMissCounter* counter) {
         U64 result = 0;
-        {
-            std::cout << "perft from initial position with depth=" << U64(depth) << std::endl;
-            engine::Game game;
-            Timer timer;
-            result = engine::fast_perft<false>(&game, depth);
-            //result = engine::fast_perft_multi_threaded<false>(&game, depth);
+#if defined(__linux__)
+        ioctl(counter->fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(counter->fd, &result, sizeof(result)) != sizeof(result)) {
+            result = 0;
+        }
+#else
+        (void)counter;
+#endif
+        return result;
+    }
+
+    static void print_layout() {
+        std::cout << "sizeof(Game)=" << sizeof(engine::Game)
+            << " (position 0-" << (offsetof(engine::Game, cold) - 1)
+            << ", cold " << offsetof(engine::Game, cold) << "-" << (offsetof(engine::Game, cold) + sizeof(engine::ColdState*) - 1) << ")"
+            << " sizeof(ColdState)=" << sizeof(engine::ColdState)
+            << " sizeof(PlyState)=" << sizeof(engine::PlyState)
+            << " sizeof(Position)=" << sizeof(engine::Position) << std::endl;
+    }
+
+    static double get_per_node(U64 count, U64 nodes) {
+        return nodes ? double(count) / double(nodes) : 0.0;
+    }
+    // #endregion
+
+    // leaves table nullptr when hash_megabytes is 0, returns false if the table could not be allocated
+    static bool make_perft_table(U64 hash_megabytes, engine::PerftTable** table) {
+        *table = nullptr;
+        if (hash_megabytes == 0) {
+            return true;
+        }
+
+        *table = new engine::PerftTable(hash_megabytes);
+        if (!(*table)->buckets) {
+            std::cerr << "could not allocate a " << hash_megabytes << "MB hash table" << std::endl;
+            delete *table;
+            *table = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+
+    // less than asked for if the allocation had to be shrunk to succeed
+    static U64 get_table_megabytes(const engine::PerftTable* table) {
+        return table ? table->bucket_count * sizeof(engine::PerftTableBucket) / (1024 * 1024) : 0;
+    }
+
+    static U64 get_nodes_per_second(U64 nodes, U64 microseconds) {
+        return microseconds ? U64(double(nodes) * 1000000.0 / double(microseconds)) : 0;
+    }
+
+    static std::string json_string(const char* str) {
+        std::string result = "\"";
+        for (U64 i = 0; str[i] != '\0'; ++i) {
+            if (str[i] == '"' || str[i] == '\\') {
+                result += '\\';
+            }
+            result += str[i];
+        }
+        result += '"';
+        return result;
+    }
+
+    static void print_json(const Options* options, U32 threads, U64 hash_megabytes, const std::vector<Run>& runs, const std::vector<DivideEntry>& divide, bool success, bool counted_cache_misses) {
+        const engine::PerftResult result = runs.back().result;
+        U64 total_microseconds = 0;
+        U64 best_nodes_per_second = 0;
+
+        std::cout << "{\n";
+        std::cout << "  \"fen\": " << json_string(options->fen) << ",\n";
+        std::cout << "  \"moves\": " << json_string(options->moves) << ",\n";
+        std::cout << "  \"depth\": " << U64(options->depth) << ",\n";
+        std::cout << "  \"threads\": " << threads << ",\n";
+        std::cout << "  \"hash_megabytes\": " << hash_megabytes << ",\n";
+        std::cout << "  \"bulk_count\": " << (options->bulk_count ? "true" : "false") << ",\n";
+        std::cout << "  \"copy_make\": " << (options->copy_make ? "true" : "false") << ",\n";
+        std::cout << "  \"detailed\": " << (options->detailed ? "true" : "false") << ",\n";
+        if (options->memory) {
+            std::cout << "  \"sizeof_game\": " << sizeof(engine::Game) << ",\n";
+            std::cout << "  \"sizeof_position_part\": " << offsetof(engine::Game, cold) << ",\n";
+            std::cout << "  \"sizeof_cold_state\": " << sizeof(engine::ColdState) << ",\n";
+            std::cout << "  \"sizeof_ply_state\": " << sizeof(engine::PlyState) << ",\n";
+            std::cout << "  \"sizeof_position\": " << sizeof(engine::Position) << ",\n";
+        }
+        std::cout << "  \"runs\": [\n";
+        for (U64 i = 0; i < runs.size(); ++i) {
+            const U64 nodes_per_second = get_nodes_per_second(runs[i].result.nodes, runs[i].microseconds);
+            total_microseconds += runs[i].microseconds;
+            if (nodes_per_second > best_nodes_per_second) {
+                best_nodes_per_second = nodes_per_second;
+            }
+            std::cout << "    {\"nodes\": " << runs[i].result.nodes
+                << ", \"microseconds\": " << runs[i].microseconds
+                << ", \"nodes_per_second\": " << nodes_per_second;
+            if (counted_cache_misses) {
+                std::cout << ", \"cache_misses\": " << runs[i].cache_misses;
+            }
+            std::cout << "}" << (i + 1 < runs.size() ? ",\n" : "\n");
+        }
+        std::cout << "  ],\n";
+        std::cout << "  \"nodes\": " << result.nodes << ",\n";
+        if (options->divided) {
+            std::cout << "  \"divide\": {";
+            for (U64 i = 0; i < divide.size(); ++i) {
+                std::cout << (i == 0 ? "\n" : ",\n") << "    \"" << divide[i].move_name << "\": " << divide[i].nodes;
+            }
+            std::cout << (divide.empty() ? "},\n" : "\n  },\n");
         }
-        if (result == expected) {
-            std::cout << "SUCCESS: " << result << std::endl;
+        if (options->detailed) {
+            std::cout << "  \"captures\": " << result.captures << ",\n";
+            std::cout << "  \"en_passant\": " << result.en_passant << ",\n";
+            std::cout << "  \"castles\": " << result.castles << ",\n";
+            std::cout << "  \"promotions\": " << result.promotions << ",\n";
+            std::cout << "  \"checks\": " << result.checks << ",\n";
+            std::cout << "  \"discovery_checks\": " << result.discovery_checks << ",\n";
+            std::cout << "  \"double_checks\": " << result.double_checks << ",\n";
+            std::cout << "  \"checkmates\": " << result.checkmates << ",\n";
+        }
+        std::cout << "  \"nodes_per_second\": " << get_nodes_per_second(result.nodes * runs.size(), total_microseconds) << ",\n";
+        std::cout << "  \"best_nodes_per_second\": " << best_nodes_per_second << ",\n";
+        if (options->expected) {
+            std::cout << "  \"expected\": " << options->expected << ",\n";
         } else {
-            std::cout << "FAILURE: actual=" << result << " expected=" << expected << std::endl;
+            std::cout << "  \"expected\": null,\n";
         }
+        std::cout << "  \"success\": " << (success ? "true" : "false") << "\n";
+        std::cout << "}" << std::endl;
     }
-}
 
-static bool is_white_space(const char* str) {
-    for (chess::U8 i = 0; ; ++i) {
-        if (str[i] == '\0') {
-            return true;
+    static void print_text(const Options* options, const Run* run, U32 run_index, bool counted_cache_misses) {
+        const engine::PerftResult result = run->result;
+        if (options->repeat > 1) {
+            std::cout << "run " << (run_index + 1) << ": ";
+        }
+        std::cout << "nodes=" << result.nodes
+            << " time=" << run->microseconds << "us (" << (run->microseconds * 0.001) << "ms)"
+            << " nps=" << get_nodes_per_second(result.nodes, run->microseconds) << std::endl;
+        if (counted_cache_misses) {
+            std::cout << "cache_misses=" << run->cache_misses << " per_node=" << get_per_node(run->cache_misses, result.nodes) << std::endl;
+        }
+        if (options->detailed) {
+            std::cout << "captures=" << result.captures
+                << " en_passant=" << result.en_passant
+                << " castles=" << result.castles
+                << " promotions=" << result.promotions
+                << " checks=" << result.checks
+                << " discovery_checks=" << result.discovery_checks
+                << " double_checks=" << result.double_checks
+                << " checkmates=" << result.checkmates << std::endl;
         }
-        if (str[i] != ' ') {
+    }
+
+    // #region epd suite
+    struct SuitePosition {
+        std::string fen;
+        engine::Position position;
+    };
+
+    struct SuiteJob {
+        U64 position_index;
+        U8 depth;
+        U64 expected;
+        U64 nodes;
+        U64 microseconds;
+    };
+
+    static std::string trim(const std::string& str) {
+        const U64 begin = str.find_first_not_of(" \t\r\n");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        const U64 end = str.find_last_not_of(" \t\r\n");
+        return str.substr(begin, end - begin + 1);
+    }
+
+    // each line is a fen followed by ";D<depth> <nodes>" fields, blank lines and lines starting with # are skipped
+    static bool load_epd(const char* path, U8 max_depth, std::vector<SuitePosition>* positions, std::vector<SuiteJob>* jobs) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "could not open " << path << std::endl;
             return false;
         }
+
+        engine::Game game;
+        std::string line;
+        for (U64 line_number = 1; std::getline(file, line); ++line_number) {
+            line = trim(line);
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+
+            U64 field_end = line.find(';');
+            const std::string fen = trim(line.substr(0, field_end));
+            if (!engine::load_fen(&game, fen.c_str())) {
+                std::cerr << path << ":" << line_number << ": invalid fen " << fen << std::endl;
+                return false;
+            }
+
+            const U64 position_index = positions->size();
+            positions->push_back(SuitePosition{fen, engine::get_position(&game)});
+
+            while (field_end != std::string::npos) {
+                const U64 field_begin = field_end + 1;
+                field_end = line.find(';', field_begin);
+                const std::string field = trim(line.substr(field_begin, field_end == std::string::npos ? std::string::npos : field_end - field_begin));
+
+                U64 depth;
+                U64 nodes;
+                const U64 space = field.find(' ');
+                if (field.size() < 2 || field[0] != 'D' || space == std::string::npos
+                    || !parse_number(field.substr(1, space - 1).c_str(), &depth) || depth == 0 || depth > 255
+                    || !parse_number(trim(field.substr(space)).c_str(), &nodes)
+                ) {
+                    std::cerr << path << ":" << line_number << ": invalid field " << field << std::endl;
+                    return false;
+                }
+
+                if (depth <= max_depth) {
+                    jobs->push_back(SuiteJob{position_index, U8(depth), nodes, 0, 0});
+                }
+            }
+        }
+
+        return true;
+    }
+
+    static int run_suite(const Options* options) {
+        std::vector<SuitePosition> positions;
+        std::vector<SuiteJob> jobs;
+        if (!load_epd(options->epd, options->max_depth, &positions, &jobs)) {
+            return 1;
+        }
+
+        // largest first, so that the long jobs do not all end up at the tail with one thread left running them
+        std::vector<U64> order(jobs.size());
+        for (U64 i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&jobs](U64 a, U64 b) { return jobs[a].expected > jobs[b].expected; });
+
+        const U32 requested_threads = options->threads_given ? options->threads : 0;
+        const U32 thread_count = requested_threads ? requested_threads : std::max(1U, std::thread::hardware_concurrency());
+        engine::PerftTable* table;
+        if (!make_perft_table(options->hash_megabytes, &table)) {
+            return 1;
+        }
+        std::atomic<U64> next_job{0};
+
+        auto worker = [&]() {
+            engine::Game game;
+            for (U64 i = next_job++; i < order.size(); i = next_job++) {
+                SuiteJob* job = &jobs[order[i]];
+                engine::set_position(&game, &positions[job->position_index].position);
+                const auto start_time = std::chrono::steady_clock::now();
+                if (options->copy_make) {
+                    job->nodes = options->bulk_count
+                        ? engine::fast_perft<false, true, engine::UndoMode::CopyMake>(&game, job->depth, table)
+                        : engine::fast_perft<false, false, engine::UndoMode::CopyMake>(&game, job->depth, table);
+                } else {
+                    job->nodes = options->bulk_count
+                        ? engine::fast_perft<false, true>(&game, job->depth, table)
+                        : engine::fast_perft<false, false>(&game, job->depth, table);
+                }
+                const auto end_time = std::chrono::steady_clock::now();
+                job->microseconds = U64(std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count());
+            }
+        };
+
+        const auto start_time = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (U32 i = 1; i < thread_count; ++i) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        const auto end_time = std::chrono::steady_clock::now();
+        const U64 microseconds = U64(std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count());
+
+        const U64 hash_megabytes = get_table_megabytes(table);
+        delete table;
+
+        U64 total_nodes = 0;
+        U64 failure_count = 0;
+        for (const SuiteJob& job : jobs) {
+            total_nodes += job.nodes;
+            if (job.nodes != job.expected) {
+                ++failure_count;
+            }
+        }
+
+        if (options->json) {
+            std::cout << "{\n";
+            std::cout << "  \"epd\": " << json_string(options->epd) << ",\n";
+            std::cout << "  \"threads\": " << thread_count << ",\n";
+            std::cout << "  \"hash_megabytes\": " << hash_megabytes << ",\n";
+            std::cout << "  \"bulk_count\": " << (options->bulk_count ? "true" : "false") << ",\n";
+            std::cout << "  \"copy_make\": " << (options->copy_make ? "true" : "false") << ",\n";
+            std::cout << "  \"jobs\": [\n";
+            for (U64 i = 0; i < jobs.size(); ++i) {
+                const SuiteJob* job = &jobs[i];
+                std::cout << "    {\"position\": " << (job->position_index + 1)
+                    << ", \"fen\": " << json_string(positions[job->position_index].fen.c_str())
+                    << ", \"depth\": " << U64(job->depth)
+                    << ", \"nodes\": " << job->nodes
+                    << ", \"expected\": " << job->expected
+                    << ", \"microseconds\": " << job->microseconds
+                    << ", \"nodes_per_second\": " << get_nodes_per_second(job->nodes, job->microseconds)
+                    << ", \"success\": " << (job->nodes == job->expected ? "true" : "false") << "}"
+                    << (i + 1 < jobs.size() ? ",\n" : "\n");
+            }
+            std::cout << "  ],\n";
+            std::cout << "  \"positions\": " << positions.size() << ",\n";
+            std::cout << "  \"nodes\": " << total_nodes << ",\n";
+            std::cout << "  \"microseconds\": " << microseconds << ",\n";
+            std::cout << "  \"nodes_per_second\": " << get_nodes_per_second(total_nodes, microseconds) << ",\n";
+            std::cout << "  \"failures\": " << failure_count << ",\n";
+            std::cout << "  \"success\": " << (failure_count == 0 ? "true" : "false") << "\n";
+            std::cout << "}" << std::endl;
+        } else {
+            for (const SuiteJob& job : jobs) {
+                std::cout << "position " << (job.position_index + 1) << " depth=" << U64(job.depth)
+                    << " nodes=" << job.nodes;
+                if (job.nodes != job.expected) {
+                    std::cout << " FAILURE expected=" << job.expected << " fen=" << positions[job.position_index].fen;
+                }
+                std::cout << " time=" << job.microseconds << "us nps=" << get_nodes_per_second(job.nodes, job.microseconds) << std::endl;
+            }
+            std::cout << positions.size() << " positions, " << jobs.size() << " jobs, " << failure_count << " failures on " << thread_count << " threads\n"
+                << "nodes=" << total_nodes << " time=" << microseconds << "us (" << (microseconds * 0.001) << "ms)"
+                << " nps=" << get_nodes_per_second(total_nodes, microseconds) << std::endl;
+            std::cout << (failure_count == 0 ? "SUCCESS" : "FAILURE") << std::endl;
+        }
+
+        return failure_count == 0 ? 0 : 1;
     }
+    // #endregion
 }
 
 int main(int argc, char* argv[]) {
-#if 0
-    // depth fen moves
-    if (argc < 2) {
+    chess::Options options;
+    bool help = false;
+    if (!chess::parse_options(argc, argv, &options, &help)) {
+        chess::print_usage();
         return 1;
     }
-    int depth = atoi(argv[1]);
-    if (depth < 0) {
-        return 1;
+
+    if (help) {
+        chess::print_usage();
+        return 0;
+    }
+
+    if (options.epd) {
+        return chess::run_suite(&options);
     }
-    const char* fen = argc >= 3 ? argv[2] : "";
-    const char* moves = argc >= 4 ? argv[3] : "";
 
     chess::engine::Game game;
 
-    if (!is_white_space(fen)) {
-        chess::engine::load_fen(&game, fen);
+    if (!chess::is_white_space(options.fen) && !chess::engine::load_fen(&game, options.fen)) {
+        std::cerr << "invalid fen " << options.fen << std::endl;
+        return 1;
     }
 
-    if (!is_white_space(moves)) {
-        chess::engine::make_moves(&game, moves);
+    if (!chess::is_white_space(options.moves) && !chess::engine::make_moves(&game, options.moves)) {
+        std::cerr << "invalid moves " << options.moves << std::endl;
+        return 1;
     }
 
-    chess::U64 result = chess::engine::fast_perft<true>(&game, static_cast<chess::U8>(depth));
-    std::cout << "\n" << result << std::endl;
-#else
-    //chess::perft(4, 197281);
-    //chess::perft(5, 4865609);
-    //chess::perft(6, 119060324);
-    chess::perft(7, 3195901860);
-    //chess::perft(8, 84998978956);
-#endif
-    
-    return 0;
+    // the detailed perft is unhashed
+    chess::engine::PerftTable* table;
+    if (!chess::make_perft_table(options.detailed ? 0 : options.hash_megabytes, &table)) {
+        return 1;
+    }
+
+    // opened before the pool so that its workers inherit the counter
+    chess::CacheMissCounter cache_miss_counter;
+    const bool counted_cache_misses = options.memory && chess::open_cache_miss_counter(&cache_miss_counter);
+    if (options.memory && !counted_cache_misses) {
+        std::cerr << "cache misses can not be counted here" << std::endl;
+    }
+
+    chess::engine::PerftThreadPool* pool = options.threads != 1 ? new chess::engine::PerftThreadPool(options.threads) : nullptr;
+    const chess::U32 threads = pool ? pool->thread_count : 1;
+    // 0 when no table is used, e.g. for the detailed perft
+    const chess::U64 hash_megabytes = chess::get_table_megabytes(table);
+
+    if (!options.json) {
+        std::cout << "perft depth=" << chess::U64(options.depth) << " threads=" << threads;
+        if (table) {
+            std::cout << " hash=" << hash_megabytes << "MB";
+        }
+        std::cout << (options.detailed ? " detailed" : "") << (options.bulk_count || options.detailed ? "" : " no-bulk") << (options.copy_make && !options.detailed ? " copy-make" : "") << std::endl;
+        if (options.memory) {
+            chess::print_layout();
+        }
+    }
+
+    std::vector<chess::Run> runs;
+    std::vector<chess::DivideEntry> divide;
+    bool success = true;
+    for (chess::U32 i = 0; i < options.repeat; ++i) {
+        // every run starts from an empty table, so that repeated runs measure the same work
+        if (table && i != 0) {
+            chess::engine::clear_perft_table(table);
+        }
+
+        if (counted_cache_misses) {
+            chess::start_cache_miss_counter(&cache_miss_counter);
+        }
+        const auto start_time = std::chrono::steady_clock::now();
+        const chess::engine::PerftResult result = options.divided && options.json
+            ? chess::run_divided_perft(&game, &options, table, pool, &divide)
+            : chess::run_perft(&game, &options, table, pool);
+        const auto end_time = std::chrono::steady_clock::now();
+        const chess::U64 cache_misses = counted_cache_misses ? chess::stop_cache_miss_counter(&cache_miss_counter) : 0;
+        runs.push_back(chess::Run{result, chess::U64(std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time).count()), cache_misses});
+
+        if (options.expected && result.nodes != options.expected) {
+            success = false;
+        }
+
+        if (!options.json) {
+            chess::print_text(&options, &runs.back(), i, counted_cache_misses);
+        }
+    }
+
+    if (options.json) {
+        chess::print_json(&options, threads, hash_megabytes, runs, divide, success, counted_cache_misses);
+    } else if (options.expected) {
+        if (success) {
+            std::cout << "SUCCESS: " << runs.back().result.nodes << std::endl;
+        } else {
+            std::cout << "FAILURE: actual=" << runs.back().result.nodes << " expected=" << options.expected << std::endl;
+        }
+    }
+
+    chess::close_cache_miss_counter(&cache_miss_counter);
+    delete table;
+    delete pool;
+
+    return success ? 0 : 1;
 }
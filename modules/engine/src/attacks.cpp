@@ -0,0 +1,182 @@
+
+#include <chess/engine/attacks.hpp>
+#include <chess/common/assert.hpp>
+
+#if CHESS_PEXT_AVAILABLE
+#include <cpuid.h>
+#endif
+
+namespace chess { namespace engine {
+    // #region internal
+    static constexpr U32 bishop_attack_table_size = 5248;
+    static constexpr U32 rook_attack_table_size = 102400;
+
+    // found offline by trial with a sparse random number generator, using the minimal shift (64 - bits in mask) for every cell
+    static constexpr U64 bishop_magics[chess_board_size]{
+        0x40106000a1160020ULL, 0x0230106090808800ULL, 0x4010210041000800ULL, 0x02240400980c2000ULL,
+        0x1304030800402088ULL, 0x140a0f1008000002ULL, 0x0001043002088080ULL, 0x0431240044102800ULL,
+        0x0000400222021200ULL, 0x0040080880809206ULL, 0x0420044104250001ULL, 0x0008841046010a40ULL,
+        0x2000020210001000ULL, 0x4000c20190080000ULL, 0x0404020801041004ULL, 0x0004004048241040ULL,
+        0x8008802002104a20ULL, 0x08080802b0840080ULL, 0x1008082a42040020ULL, 0x2118010402142012ULL,
+        0x2002800400a08004ULL, 0x2108080082012020ULL, 0x2054038069080800ULL, 0x0000400202020110ULL,
+        0x0230404825040481ULL, 0x1030310108012102ULL, 0x8808020a11140105ULL, 0x0014040038020808ULL,
+        0x2084040018410040ULL, 0x8409420001c11030ULL, 0x000088904c020830ULL, 0x00032a0401420080ULL,
+        0xa204824014602422ULL, 0xc9021a1308e00824ULL, 0x0404020100420400ULL, 0x2800600800048820ULL,
+        0x00084a0020120080ULL, 0x00041000800c1040ULL, 0x2004081880004400ULL, 0x0042040031250091ULL,
+        0xc20a082008004400ULL, 0x1124010882122800ULL, 0x8842010101002081ULL, 0x4001044200808808ULL,
+        0x0000240102122400ULL, 0x3082240806020221ULL, 0x803010b218808040ULL, 0x1034a40400400020ULL,
+        0x4081040120690000ULL, 0x00420a12090c8500ULL, 0x0808420124090940ULL, 0x1110050042020001ULL,
+        0x0d60224099024000ULL, 0x0100084218820081ULL, 0x08882048088504a8ULL, 0x2406088f01060390ULL,
+        0x000202010c829000ULL, 0x0260010421010810ULL, 0x0004200a004208a0ULL, 0x0222000800208821ULL,
+        0x0083040004104421ULL, 0x2011808810100224ULL, 0x2102a02002208100ULL, 0x0002420441020602ULL
+    };
+
+    static constexpr U64 rook_magics[chess_board_size]{
+        0x0880004000108025ULL, 0x34c00048a0001000ULL, 0x0880100108802000ULL, 0x0580080014b00081ULL,
+        0x2080020400080080ULL, 0x0200010200100408ULL, 0x0200412088040200ULL, 0x2180048000402100ULL,
+        0x2840800040102080ULL, 0x0002802001804000ULL, 0x0002002088120040ULL, 0x9008808008001000ULL,
+        0x4000808004000800ULL, 0x011a000200100804ULL, 0x8041008100020004ULL, 0x0e63001860820100ULL,
+        0x0440848002c00420ULL, 0x2010890040010021ULL, 0x8800110020044300ULL, 0x0208010100201000ULL,
+        0x1222020004102008ULL, 0x0000808002000400ULL, 0x20040400094a9008ULL, 0x0000420000804401ULL,
+        0x0040002880004680ULL, 0x0000200240100040ULL, 0x0020008180201001ULL, 0x01080080800c1000ULL,
+        0x0104040080800800ULL, 0x4800020080040080ULL, 0x0002000200840108ULL, 0x00a1000100006082ULL,
+        0x8004400088800260ULL, 0x0100804000802008ULL, 0x0010008010802002ULL, 0x000c801000800800ULL,
+        0x0c51800402800800ULL, 0x0002800200800400ULL, 0x0000820804000110ULL, 0x4003808042000401ULL,
+        0x00208020c0018000ULL, 0x4400402010004009ULL, 0x22100400a800e000ULL, 0x0e020021400a0013ULL,
+        0x10a0080100110005ULL, 0x0004010002004040ULL, 0x0024080102040010ULL, 0x4154089108420014ULL,
+        0x0182400080002380ULL, 0x0000400110802100ULL, 0x0000100080200480ULL, 0x100a000820401200ULL,
+        0x8081004020801002ULL, 0x0002000408100200ULL, 0x03223a1008010c00ULL, 0x000000831c014200ULL,
+        0x4200208009001041ULL, 0xc001004000881021ULL, 0x1008200100100841ULL, 0x0000082240920032ULL,
+        0x4002000804201102ULL, 0xb821000804000201ULL, 0x4080c208102100a4ULL, 0x02020900418c0ca2ULL
+    };
+
+    static constexpr Direction bishop_directions[4]{Direction::NorthEast, Direction::SouthEast, Direction::SouthWest, Direction::NorthWest};
+    static constexpr Direction rook_directions[4]{Direction::North, Direction::East, Direction::South, Direction::West};
+
+    static Bitboard bishop_magic_attack_table[bishop_attack_table_size];
+    static Bitboard rook_magic_attack_table[rook_attack_table_size];
+    static Bitboard bishop_pext_attack_table[bishop_attack_table_size];
+    static Bitboard rook_pext_attack_table[rook_attack_table_size];
+
+    static Bitboard get_sliding_attacks(Bitboard::Index index, Bitboard occupancy, const Direction* directions) {
+        Bitboard result;
+        for (U8 i = 0; i < 4; ++i) {
+            result |= slide_in_direction(Bitboard(index), directions[i], occupancy);
+        }
+        return result;
+    }
+
+    // the cells whose occupancy changes the attacks from index, the last cell of each ray never blocks anything so is excluded
+    static Bitboard get_sliding_mask(Bitboard::Index index, const Direction* directions) {
+        Bitboard result;
+        for (U8 i = 0; i < 4; ++i) {
+            Bitboard cell = move_in_direction(Bitboard(index), directions[i]);
+            while (cell && move_in_direction(cell, directions[i])) {
+                result |= cell;
+                cell = move_in_direction(cell, directions[i]);
+            }
+        }
+        return result;
+    }
+
+    static void init_attack_entries(SliderAttackEntry* entries, const U64* magics, Bitboard* magic_table, Bitboard* pext_table, const Direction* directions) {
+        U32 offset = 0;
+        for (U8 i = 0; i < chess_board_size; ++i) {
+            const Bitboard::Index index(i);
+            SliderAttackEntry* entry = &entries[i];
+            entry->mask = get_sliding_mask(index, directions);
+            entry->magic = magics[i];
+            entry->magic_attacks = &magic_table[offset];
+            entry->pext_attacks = &pext_table[offset];
+            entry->shift = U8(chess_board_size - __builtin_popcountll(entry->mask.data));
+
+            // enumerate every subset of the mask (carry-rippler) and store its attacks,
+            // the subsets are visited in increasing order, so the nth subset is the one PEXT maps to n
+            Bitboard occupancy;
+            U32 pext_key = 0;
+            do {
+                const Bitboard attacks = get_sliding_attacks(index, occupancy, directions);
+                const U64 magic_key = (occupancy.data * entry->magic) >> entry->shift;
+                magic_table[offset + magic_key] = attacks;
+                pext_table[offset + pext_key] = attacks;
+                ++pext_key;
+                occupancy = Bitboard((occupancy.data - entry->mask.data) & entry->mask.data);
+            } while (occupancy);
+
+            offset += 1U << (chess_board_size - entry->shift);
+        }
+    }
+
+    static bool has_fast_pext() {
+#if CHESS_PEXT_AVAILABLE
+        unsigned int eax;
+        unsigned int ebx;
+        unsigned int ecx;
+        unsigned int edx;
+
+        if (!__get_cpuid(0, &eax, &ebx, &ecx, &edx) || eax < 7) {
+            return false;
+        }
+
+        // "AuthenticAMD" is split across ebx, edx and ecx
+        const bool amd = ebx == 0x68747541 && edx == 0x69746e65 && ecx == 0x444d4163;
+
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+
+        const unsigned int base_family = (eax >> 8) & 0xF;
+        const unsigned int family = base_family == 0xF ? base_family + ((eax >> 20) & 0xFF) : base_family;
+
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+        const bool bmi2 = ebx & (1 << 8);
+
+        // AMD cpus before Zen 3 (family 19h) implement PEXT in microcode, taking hundreds of cycles, so magic lookup is faster there
+        return bmi2 && !(amd && family < 0x19);
+#else
+        return false;
+#endif
+    }
+
+    static bool fill_attack_tables() {
+        init_attack_entries(bishop_attack_entries, bishop_magics, bishop_magic_attack_table, bishop_pext_attack_table, bishop_directions);
+        init_attack_entries(rook_attack_entries, rook_magics, rook_magic_attack_table, rook_pext_attack_table, rook_directions);
+        if (has_fast_pext()) {
+            slider_backend = SliderBackend::Pext;
+        }
+        return true;
+    }
+    // #endregion
+
+    SliderAttackEntry bishop_attack_entries[chess_board_size];
+    SliderAttackEntry rook_attack_entries[chess_board_size];
+    SliderBackend slider_backend = SliderBackend::Magic;
+
+    void init_attack_tables() {
+        // a function local static so that static initialisers in other translation units, e.g. a global Game, can fill the
+        // tables before they use them regardless of initialisation order
+        static const bool initialised = fill_attack_tables();
+        (void)initialised;
+    }
+
+    // also fill them at startup for code that looks up attacks without making a Game first
+    [[maybe_unused]] static const bool attack_tables_initialised = (init_attack_tables(), true);
+
+    bool is_slider_backend_supported(SliderBackend backend) {
+        if (backend == SliderBackend::Pext) {
+            return has_fast_pext();
+        }
+
+        return true;
+    }
+
+    bool set_slider_backend(SliderBackend backend) {
+        init_attack_tables();
+        if (!is_slider_backend_supported(backend)) {
+            return false;
+        }
+
+        slider_backend = backend;
+        return true;
+    }
+}}
@@ -1,10 +1,19 @@
 
 #include <chess/engine/engine.hpp>
+#include <chess/engine/attacks.hpp>
+#include <chess/engine/zobrist.hpp>
 #include <chess/common/assert.hpp>
 #include <stdlib.h>
 #include <utility>
 #include <cstdio>
-#include <future>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 // TODO(TB): remove this
 #include <iostream>
 
@@ -56,145 +65,123 @@ namespace chess { namespace engine {
         x->flags |= game->next_turn << 4;
     }
 
-    static void add_move(Game* game, Move move) {
-        if (game->moves_index >= game->moves_allocated) {
-            game->moves_allocated = game->moves_allocated * 2;
-            game->moves = static_cast<Move*>(realloc(game->moves, sizeof(Move) * game->moves_allocated));
+    static inline UndoRecord get_undo_record(const Game* game) {
+        UndoRecord result;
+        result.taken_piece_type = Piece::Type::Empty;
+        result.en_passant_cell = game->en_passant_cell;
+        result.can_en_passant = game->can_en_passant;
+        result.white_can_never_castle_short = game->white_can_never_castle_short;
+        result.white_can_never_castle_long = game->white_can_never_castle_long;
+        result.black_can_never_castle_short = game->black_can_never_castle_short;
+        result.black_can_never_castle_long = game->black_can_never_castle_long;
+        return result;
+    }
+
+    // the ply state of the position the move leads to is left for the caller to fill in
+    static void add_move(Game* game, Move move, UndoRecord undo_record) {
+        if (game->cold->moves_index + 1 >= game->cold->moves_allocated) {
+            game->cold->moves_allocated = game->cold->moves_allocated * 2;
+            game->cold->moves = static_cast<Move*>(realloc(game->cold->moves, sizeof(Move) * game->cold->moves_allocated));
+            game->cold->plies = static_cast<PlyState*>(realloc(game->cold->plies, sizeof(PlyState) * game->cold->moves_allocated));
+        }
+
+        CHESS_ASSERT(game->cold->moves_index + 1 < game->cold->moves_allocated);
+        game->cold->moves[game->cold->moves_index] = move;
+        game->cold->plies[game->cold->moves_index].undo_record = undo_record;
+        ++game->cold->moves_index;
+        game->cold->moves_count = game->cold->moves_index;
+    }
+
+    // recalculates colour_pieces from pieces, only needed after pieces is written directly
+    static inline void update_occupancy(Game* game) {
+        for (U8 colour = 0; colour < 2; ++colour) {
+            Bitboard result;
+            for (U8 type = 0; type < piece_type_count; ++type) {
+                result |= game->pieces[colour][type];
+            }
+            game->colour_pieces[colour] = result;
         }
+    }
 
-        CHESS_ASSERT(game->moves_index < game->moves_allocated);
-        game->moves[game->moves_index] = std::move(move);
-        ++game->moves_index;
-        game->moves_count = game->moves_index;
+    template <Colour colour>
+    static inline void remove_friendly_piece(Game* game, Bitboard index_bitboard, Piece::Type piece_type) {
+        CHESS_ASSERT(piece_type != Piece::Type::Empty);
+        game->pieces[U8(colour)][get_piece_type_index(piece_type)] &= ~index_bitboard;
+        game->colour_pieces[U8(colour)] &= ~index_bitboard;
+        game->key ^= get_piece_key(colour, piece_type, Bitboard::Index(__builtin_ctzll(index_bitboard.data)));
     }
 
     template <Colour colour, Piece::Type piece_type>
     static inline void remove_friendly_piece(Game* game, Bitboard index_bitboard) {
         static_assert(piece_type != Piece::Type::Empty);
-        if constexpr (piece_type == Piece::Type::Pawn) {
-            *get_friendly_pawns<colour>(game) &= ~index_bitboard;
-        } else if constexpr (piece_type == Piece::Type::Knight) {
-            *get_friendly_knights<colour>(game) &= ~index_bitboard;
-        } else if constexpr (piece_type == Piece::Type::Bishop) {
-            *get_friendly_bishops<colour>(game) &= ~index_bitboard;
-        } else if constexpr (piece_type == Piece::Type::Rook) {
-            *get_friendly_rooks<colour>(game) &= ~index_bitboard;
-        } else if constexpr (piece_type == Piece::Type::Queen) {
-            *get_friendly_queens<colour>(game) &= ~index_bitboard;
-        } else {
-            static_assert(piece_type == Piece::Type::King);
-            *get_friendly_kings<colour>(game) &= ~index_bitboard;
-        }
+        remove_friendly_piece<colour>(game, index_bitboard, piece_type);
     }
 
+    // removes whatever piece, other than a king, is at index_bitboard, returning its type, Empty if there is none
     template <Colour colour>
     static inline Piece::Type remove_friendly_piece(Game* game, Bitboard index_bitboard) {
-        if (has_friendly_pawn<colour>(game, index_bitboard)) {
-            *get_friendly_pawns<colour>(game) &= ~index_bitboard;
-            return Piece::Type::Pawn;
-        } else if (has_friendly_knight<colour>(game, index_bitboard)) {
-            *get_friendly_knights<colour>(game) &= ~index_bitboard;
-            return Piece::Type::Knight;
-        } else if (has_friendly_bishop<colour>(game, index_bitboard)) {
-            *get_friendly_bishops<colour>(game) &= ~index_bitboard;
-            return Piece::Type::Bishop;
-        } else if (has_friendly_rook<colour>(game, index_bitboard)) {
-            *get_friendly_rooks<colour>(game) &= ~index_bitboard;
-            return Piece::Type::Rook;
-        } else if (has_friendly_queen<colour>(game, index_bitboard)) {
-            *get_friendly_queens<colour>(game) &= ~index_bitboard;
-            return Piece::Type::Queen;
-        } else {
-            CHESS_ASSERT(!has_friendly_king<colour>(game, index_bitboard));
+        if (!(game->colour_pieces[U8(colour)] & index_bitboard)) {
             return Piece::Type::Empty;
         }
+
+        CHESS_ASSERT(!has_friendly_king<colour>(game, index_bitboard));
+        U8 type = 0;
+        while (!(game->pieces[U8(colour)][type] & index_bitboard)) {
+            ++type;
+        }
+        CHESS_ASSERT(type < get_piece_type_index(Piece::Type::King));
+
+        const Piece::Type result = Piece::Type(type + U8(Piece::Type::Pawn));
+        remove_friendly_piece<colour>(game, index_bitboard, result);
+        return result;
     }
 
     template <Colour colour>
     static inline Bitboard get_pawn_attack_cells(const Game* game, Bitboard bitboard) {
-        return (move_forward<colour>(move_east(bitboard)) & ~bitboard_file[U8(File::A)]) | (move_forward<colour>(move_west(bitboard)) & ~bitboard_file[U8(File::H)]);
+        return get_pawn_attacks<colour>(bitboard);
     }
 
     template <Colour colour>
     static inline Bitboard get_pawn_non_attack_moves_excluding_en_passant(const Game* game, Bitboard bitboard) {
-        const Bitboard all_pieces_complement = ~(get_friendly_pieces<colour>(game) | get_friendly_pieces<EnemyColour<colour>::colour>(game));
+        const Bitboard all_pieces_complement = ~get_all_pieces(game);
         Bitboard result = move_forward<colour>(bitboard) & all_pieces_complement;
         result |= move_forward<colour>(result) & bitboard_rank[U8(move_forward<colour>(move_forward<colour>(move_forward<colour>(rear_rank<colour>()))))] & all_pieces_complement;
         return result;
     }
 
     template <Colour colour>
-    static inline Bitboard get_pawn_moves_excluding_en_passant(const Game* game, Bitboard bitboard) {
+    static inline Bitboard get_pawn_moves_excluding_en_passant(const Game* game, Bitboard::Index index) {
+        const Bitboard bitboard(index);
         CHESS_ASSERT((bitboard & *get_friendly_pawns<colour>(game)) == bitboard);
         CHESS_ASSERT(!is_rank(bitboard, rear_rank<colour>()) && !is_rank(bitboard, front_rank<colour>()));;
         CHESS_ASSERT(game->next_turn ? colour == Colour::Black : colour == Colour::White);
 
-        return (get_pawn_attack_cells<colour>(game, bitboard) & get_friendly_pieces<EnemyColour<colour>::colour>(game))
+        return (get_pawn_attacks<colour>(index) & get_friendly_pieces<EnemyColour<colour>::colour>(game))
             | get_pawn_non_attack_moves_excluding_en_passant<colour>(game, bitboard);
     }
 
     template <Colour colour>
     static inline Bitboard get_knight_attack_cells(const Game* game, Bitboard bitboard) {
-        return (
-            (
-                (move_north(move_north_east(bitboard)) | move_south(move_south_east(bitboard)))
-                & ~bitboard_file[U8(File::A)]
-            ) | (
-                (move_east(move_north_east(bitboard)) | move_east(move_south_east(bitboard)))
-                & ~(bitboard_file[U8(File::A)] | bitboard_file[U8(File::B)])
-            ) | (
-                (move_north(move_north_west(bitboard)) | move_south(move_south_west(bitboard)))
-                & ~bitboard_file[U8(File::H)]
-            ) | (
-                (move_west(move_north_west(bitboard)) | move_west(move_south_west(bitboard)))
-                & ~(bitboard_file[U8(File::H)] | bitboard_file[U8(File::G)])
-            )
-        );
+        return get_knight_attacks(bitboard);
     }
 
     template <Colour colour>
-    static inline Bitboard get_knight_moves(const Game* game, Bitboard bitboard) {
-        CHESS_ASSERT((bitboard & *get_friendly_knights<colour>(game)) == bitboard);
+    static inline Bitboard get_knight_moves(const Game* game, Bitboard::Index index) {
+        CHESS_ASSERT(has_friendly_knight<colour>(game, Bitboard(index)));
 
-        return  get_knight_attack_cells<colour>(game, bitboard) & ~get_friendly_pieces<colour>(game);
+        return get_knight_attacks(index) & ~get_friendly_pieces<colour>(game);
     }
 
     template <Colour colour, bool exclude_enemy_king = false>
     static inline Bitboard get_bishop_attack_cells(const Game* game, Bitboard bitboard) {
         CHESS_ASSERT((bitboard & (*get_friendly_bishops<colour>(game) | *get_friendly_queens<colour>(game))) == bitboard);
 
-        const Bitboard friendly_pieces_and_enemy_pieces_complement = ~(get_friendly_pieces<colour>(game) | get_friendly_pieces<EnemyColour<colour>::colour, exclude_enemy_king>(game));
-        const Bitboard file_a_complement = ~bitboard_file[U8(File::A)];
-        const Bitboard file_h_complement = ~bitboard_file[U8(File::H)];
+        const Bitboard occupancy = get_friendly_pieces<colour>(game) | get_friendly_pieces<EnemyColour<colour>::colour, exclude_enemy_king>(game);
         Bitboard result;
-        Bitboard temp_result;
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_east(temp_result) & file_a_complement;
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_east(temp_result) & file_a_complement;
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_west(temp_result) & file_h_complement;
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_west(temp_result) & file_h_complement;
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
+        for (U8 index_plus_one = __builtin_ffsll(bitboard.data); index_plus_one; index_plus_one = __builtin_ffsll(bitboard.data)) {
+            const Bitboard::Index index(index_plus_one - 1);
+            result |= get_bishop_attacks(index, occupancy);
+            bitboard &= ~Bitboard(index);
         }
 
         return result;
@@ -203,79 +190,23 @@ namespace chess { namespace engine {
     template <Colour colour>
     static inline Bitboard get_bishop_moves(const Game* game, Bitboard bitboard) {
         CHESS_ASSERT((bitboard & (*get_friendly_bishops<colour>(game) | *get_friendly_queens<colour>(game))) == bitboard);
+        CHESS_ASSERT(__builtin_popcountll(bitboard.data) == 1);
 
         const Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
-        const Bitboard enemy_pieces = get_friendly_pieces<EnemyColour<colour>::colour>(game);
-        const Bitboard friendly_pieces_and_file_a_complement = ~(friendly_pieces | bitboard_file[U8(File::A)]);
-        const Bitboard friendly_pieces_and_file_h_complement = ~(friendly_pieces | bitboard_file[U8(File::H)]);
-        Bitboard result;
-        Bitboard temp_result;
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_east(temp_result) & friendly_pieces_and_file_a_complement;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_east(temp_result) & friendly_pieces_and_file_a_complement;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_west(temp_result) & friendly_pieces_and_file_h_complement;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_west(temp_result) & friendly_pieces_and_file_h_complement;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        return result;
+        const Bitboard occupancy = get_all_pieces(game);
+        return get_bishop_attacks(Bitboard::Index(__builtin_ctzll(bitboard.data)), occupancy) & ~friendly_pieces;
     }
 
     template <Colour colour, bool exclude_enemy_king = false>
     static inline Bitboard get_rook_attack_cells(const Game* game, Bitboard bitboard) {
         CHESS_ASSERT((bitboard & (*get_friendly_rooks<colour>(game) | *get_friendly_queens<colour>(game))) == bitboard);
 
-        const Bitboard friendly_pieces_and_enemy_pieces_complement = ~(get_friendly_pieces<colour>(game) | get_friendly_pieces<EnemyColour<colour>::colour, exclude_enemy_king>(game));
+        const Bitboard occupancy = get_friendly_pieces<colour>(game) | get_friendly_pieces<EnemyColour<colour>::colour, exclude_enemy_king>(game);
         Bitboard result;
-        Bitboard temp_result;
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_east(temp_result) & ~bitboard_file[U8(File::A)];
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south(temp_result);
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_west(temp_result) & ~bitboard_file[U8(File::H)];
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north(temp_result);
-            result |= temp_result;
-            temp_result &= friendly_pieces_and_enemy_pieces_complement;
+        for (U8 index_plus_one = __builtin_ffsll(bitboard.data); index_plus_one; index_plus_one = __builtin_ffsll(bitboard.data)) {
+            const Bitboard::Index index(index_plus_one - 1);
+            result |= get_rook_attacks(index, occupancy);
+            bitboard &= ~Bitboard(index);
         }
 
         return result;
@@ -284,41 +215,11 @@ namespace chess { namespace engine {
     template <Colour colour>
     static inline Bitboard get_rook_moves(const Game* game, Bitboard bitboard) {
         CHESS_ASSERT((bitboard & (*get_friendly_rooks<colour>(game) | *get_friendly_queens<colour>(game))) == bitboard);
+        CHESS_ASSERT(__builtin_popcountll(bitboard.data) == 1);
 
         const Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
-        const Bitboard enemy_pieces = get_friendly_pieces<EnemyColour<colour>::colour>(game);
-        Bitboard result;
-        Bitboard temp_result;
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_east(temp_result) & ~(friendly_pieces | bitboard_file[U8(File::A)]);
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south(temp_result) & ~friendly_pieces;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_west(temp_result) & ~(friendly_pieces | bitboard_file[U8(File::H)]);
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        temp_result = bitboard;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north(temp_result) & ~friendly_pieces;
-            result |= temp_result;
-            temp_result &= ~enemy_pieces;
-        }
-
-        return result;
+        const Bitboard occupancy = get_all_pieces(game);
+        return get_rook_attacks(Bitboard::Index(__builtin_ctzll(bitboard.data)), occupancy) & ~friendly_pieces;
     }
 
     template <Colour colour>
@@ -330,19 +231,14 @@ namespace chess { namespace engine {
     static inline Bitboard get_king_attack_cells(const Game* game, Bitboard bitboard) {
         CHESS_ASSERT((bitboard & *get_friendly_kings<colour>(game)) == bitboard);
 
-        return (
-            ((move_north_east(bitboard) | move_east(bitboard) | move_south_east(bitboard)) & ~bitboard_file[U8(File::A)])
-            | ((move_north_west(bitboard) | move_west(bitboard) | move_south_west(bitboard)) & ~bitboard_file[U8(File::H)])
-            | move_north(bitboard)
-            | move_south(bitboard)
-        );
+        return get_king_attacks(bitboard);
     }
 
     template <Colour colour>
-    static inline Bitboard get_king_attack_moves(const Game* game, Bitboard bitboard) {
-        CHESS_ASSERT((bitboard & *get_friendly_kings<colour>(game)) == bitboard);
+    static inline Bitboard get_king_attack_moves(const Game* game, Bitboard::Index index) {
+        CHESS_ASSERT(has_friendly_king<colour>(game, Bitboard(index)));
 
-        return get_king_attack_cells<colour>(game, bitboard) & ~get_friendly_pieces<colour>(game);
+        return get_king_attacks(index) & ~get_friendly_pieces<colour>(game);
     }
 
     template <Colour colour, bool exclude_enemy_king = false>
@@ -359,16 +255,18 @@ namespace chess { namespace engine {
             | get_king_attack_cells<colour>(game, *get_friendly_kings<colour>(game));
     }
 
+    // the king can not castle out of, through or into a cell in enemy_attacks
     template <Colour colour>
-    static inline Bitboard get_king_moves(const Game* game, Bitboard bitboard) {
-        Bitboard result = get_king_attack_moves<colour>(game, bitboard);
+    static inline Bitboard get_king_moves(const Game* game, Bitboard::Index index, Bitboard enemy_attacks) {
+        const Bitboard bitboard(index);
+        Bitboard result = get_king_attack_moves<colour>(game, index);
 
         // TODO(TB): make this branchless?
         if (!can_never_castle_long<colour>(game)
             && is_empty(game, Bitboard(File::B, rear_rank<colour>()))
             && is_empty(game, Bitboard(File::C, rear_rank<colour>()))
             && is_empty(game, Bitboard(File::D, rear_rank<colour>()))
-            && !(get_attack_cells<EnemyColour<colour>::colour>(game) & (Bitboard(File::C, rear_rank<colour>()) | Bitboard(File::D, rear_rank<colour>()) | bitboard)))
+            && !(enemy_attacks & (Bitboard(File::C, rear_rank<colour>()) | Bitboard(File::D, rear_rank<colour>()) | bitboard)))
         {
             result |= Bitboard(File::C, rear_rank<colour>());
         }
@@ -376,7 +274,7 @@ namespace chess { namespace engine {
         if (!can_never_castle_short<colour>(game)
             && is_empty(game, Bitboard(File::F, rear_rank<colour>()))
             && is_empty(game, Bitboard(File::G, rear_rank<colour>()))
-            && !(get_attack_cells<EnemyColour<colour>::colour>(game) & (Bitboard(File::F, rear_rank<colour>()) | Bitboard(File::G, rear_rank<colour>()) | bitboard)))
+            && !(enemy_attacks & (Bitboard(File::F, rear_rank<colour>()) | Bitboard(File::G, rear_rank<colour>()) | bitboard)))
         {
             result |= Bitboard(File::G, rear_rank<colour>());;
         }
@@ -384,165 +282,77 @@ namespace chess { namespace engine {
         return result;
     }
 
-    template <Colour colour>
-    static bool test_for_check_after_pseudo_legal_move(Game* game, Move the_move) {
-        // NOTE(TB): check data is not being updated here, so cannot use it to test for check
-        set_taken_piece_type(&the_move.compressed_taken_and_promotion_piece_type, perform_move<colour>(game, the_move));
-        const bool result = get_attack_cells<EnemyColour<colour>::colour>(game) & *get_friendly_kings<colour>(game);
-        unperform_move<colour>(game, the_move);
-        return result;
-    }
-
     template <Colour colour>
     static bool test_for_check_after_move(Game* game, Move the_move) {
         // NOTE(TB): check data is not being updated here, so cannot use it to test for check
-        set_taken_piece_type(&the_move.compressed_taken_and_promotion_piece_type, perform_move<colour>(game, the_move));
+        UndoRecord undo_record = get_undo_record(game);
+        undo_record.taken_piece_type = perform_move<colour>(game, the_move);
         const bool result = get_attack_cells_excluding_king<EnemyColour<colour>::colour>(game) & *get_friendly_kings<colour>(game);
-        unperform_move<colour>(game, the_move);
+        unperform_move<colour>(game, the_move, undo_record);
         return result;
     }
 
+    // the ray from the king up to and including the first enemy piece, if that piece is one of the given enemy sliders, otherwise empty
+    static inline Bitboard get_skewer(Bitboard ray, Bitboard enemy_sliders) {
+        return (ray & enemy_sliders) ? ray : Bitboard();
+    }
+
     template <Colour colour>
-    static void calculate_check_data(Game* game) {
+    static inline void calculate_skewers(const Game* game, CheckData* check_data) {
         const Bitboard kings = *get_friendly_kings<colour>(game);
-        const Bitboard enemy_pieces_complement = ~get_friendly_pieces<EnemyColour<colour>::colour>(game);
-        Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
-        const Bitboard file_a_complement = ~bitboard_file[U8(File::A)];
-        const Bitboard file_h_complement = ~bitboard_file[U8(File::H)];
+        CHESS_ASSERT(__builtin_popcountll(kings.data) == 1);
+        const Bitboard::Index king_index(__builtin_ctzll(kings.data));
+        const Bitboard enemy_pieces = get_friendly_pieces<EnemyColour<colour>::colour>(game);
         const Bitboard enemy_rooks_and_queens = (*get_friendly_rooks<EnemyColour<colour>::colour>(game) | *get_friendly_queens<EnemyColour<colour>::colour>(game));
         const Bitboard enemy_bishops_and_queens = (*get_friendly_bishops<EnemyColour<colour>::colour>(game) | *get_friendly_queens<EnemyColour<colour>::colour>(game));
 
-        CheckData* check_data = get_check_data(game);
-
-        // north
-        Bitboard result;
-        Bitboard temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north(temp_result);
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
-
-        Bitboard sliding_enemy_intersection = result & enemy_rooks_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_south(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->north_skewer = result;
-
-        // north east
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_east(temp_result) & file_a_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
-
-        sliding_enemy_intersection = result & enemy_bishops_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_south_west(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->north_east_skewer = result;
-
-        // east
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_east(temp_result) & file_a_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
-
-        sliding_enemy_intersection = result & enemy_rooks_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_west(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->east_skewer = result;
-
-        // south east
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_east(temp_result) & file_a_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
-
-        sliding_enemy_intersection = result & enemy_bishops_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_north_west(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->south_east_skewer = result;
-
-        // south
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south(temp_result);
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
-
-        sliding_enemy_intersection = result & enemy_rooks_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_north(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->south_skewer = result;
+        // friendly pieces are transparent, so each ray stops at the first enemy piece
+        const Bitboard rook_rays = get_rook_attacks(king_index, enemy_pieces);
+        const Bitboard bishop_rays = get_bishop_attacks(king_index, enemy_pieces);
 
-        // south west
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_south_west(temp_result) & file_h_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
+        check_data->north_skewer = get_skewer(rook_rays & get_ray(king_index, Direction::North), enemy_rooks_and_queens);
+        check_data->north_east_skewer = get_skewer(bishop_rays & get_ray(king_index, Direction::NorthEast), enemy_bishops_and_queens);
+        check_data->east_skewer = get_skewer(rook_rays & get_ray(king_index, Direction::East), enemy_rooks_and_queens);
+        check_data->south_east_skewer = get_skewer(bishop_rays & get_ray(king_index, Direction::SouthEast), enemy_bishops_and_queens);
+        check_data->south_skewer = get_skewer(rook_rays & get_ray(king_index, Direction::South), enemy_rooks_and_queens);
+        check_data->south_west_skewer = get_skewer(bishop_rays & get_ray(king_index, Direction::SouthWest), enemy_bishops_and_queens);
+        check_data->west_skewer = get_skewer(rook_rays & get_ray(king_index, Direction::West), enemy_rooks_and_queens);
+        check_data->north_west_skewer = get_skewer(bishop_rays & get_ray(king_index, Direction::NorthWest), enemy_bishops_and_queens);
+    }
 
-        sliding_enemy_intersection = result & enemy_bishops_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_north_east(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->south_west_skewer = result;
+    // the pieces of candidates that are the only piece between the king and one of the given sliders
+    static inline Bitboard calculate_blockers(Bitboard::Index king_index, Bitboard all_pieces, Bitboard candidates, Bitboard rooks_and_queens, Bitboard bishops_and_queens) {
+        // sliders that would attack the king on an empty board
+        Bitboard snipers = (get_rook_attacks(king_index, Bitboard()) & rooks_and_queens)
+            | (get_bishop_attacks(king_index, Bitboard()) & bishops_and_queens);
 
-        // west
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_west(temp_result) & file_h_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
+        Bitboard result;
+        for (; snipers; snipers &= Bitboard(snipers.data - 1)) {
+            const Bitboard blockers = get_between(king_index, Bitboard::Index(__builtin_ctzll(snipers.data))) & all_pieces;
+            if (__builtin_popcountll(blockers.data) == 1) {
+                result |= blockers & candidates;
+            }
         }
 
-        sliding_enemy_intersection = result & enemy_rooks_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_east(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->west_skewer = result;
+        return result;
+    }
 
-        // north west
-        result = Bitboard();
-        temp_result = kings;
-        for (U8 i = 0; i < (chess_board_edge_size - 1); ++i) {
-            temp_result = move_north_west(temp_result) & file_h_complement;
-            result |= temp_result;
-            temp_result &= enemy_pieces_complement;
-        }
+    template <Colour colour>
+    static inline Bitboard calculate_pinned(const Game* game, Bitboard::Index king_index) {
+        const Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
+        return calculate_blockers(
+            king_index,
+            get_all_pieces(game),
+            friendly_pieces,
+            *get_friendly_rooks<EnemyColour<colour>::colour>(game) | *get_friendly_queens<EnemyColour<colour>::colour>(game),
+            *get_friendly_bishops<EnemyColour<colour>::colour>(game) | *get_friendly_queens<EnemyColour<colour>::colour>(game)
+        );
+    }
 
-        sliding_enemy_intersection = result & enemy_bishops_and_queens;
-        for (U8 i = 0; i < (chess_board_edge_size - 2); ++i) {
-            sliding_enemy_intersection |= move_south_east(sliding_enemy_intersection);
-        }
-        result &= sliding_enemy_intersection;
-        check_data->north_west_skewer = result;
+    template <Colour colour>
+    static void calculate_checks(const Game* game, CheckData* check_data, Bitboard::Index king_index) {
+        const Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
 
-        // check resolution bitboard
         check_data->single_check = false;
         check_data->double_check = false;
 
@@ -628,7 +438,7 @@ namespace chess { namespace engine {
             }
         }
 
-        if (Bitboard checking_knight = get_knight_attack_cells<colour>(game, kings) & *get_friendly_knights<EnemyColour<colour>::colour>(game)) {
+        if (Bitboard checking_knight = get_knight_attacks(king_index) & *get_friendly_knights<EnemyColour<colour>::colour>(game)) {
             if (check_data->single_check) {
                 check_data->double_check = true;
                 check_data->check_resolution_bitboard = Bitboard();
@@ -639,7 +449,7 @@ namespace chess { namespace engine {
             }
         }
 
-        if (Bitboard checking_pawn = get_pawn_attack_cells<colour>(game, kings) & *get_friendly_pawns<EnemyColour<colour>::colour>(game)) {
+        if (Bitboard checking_pawn = get_pawn_attacks<colour>(king_index) & *get_friendly_pawns<EnemyColour<colour>::colour>(game)) {
             if (check_data->single_check) {
                 check_data->double_check = true;
                 check_data->check_resolution_bitboard = Bitboard();
@@ -653,16 +463,123 @@ namespace chess { namespace engine {
         if (!check_data->single_check) {
             check_data->check_resolution_bitboard = ~Bitboard();
         }
+    }
+
+    // #region cache
+    // how making or undoing a move invalidates the cache, a search never asks for a position's moves twice, so it
+    // just clears it, while the public api keeps whatever entries the move can not have changed
+    enum class CacheUpdate : U8 {
+        Clear,
+        Incremental
+    };
+
+    // invalidates every entry
+    template <Colour colour>
+    static inline void update_cache(Game* game) {
+        game->cold->cache.possible_moves_calculated = Bitboard();
+    }
+
+    // a side in check can only resolve the check, so none of its entries survive going into or out of check
+    template <Colour colour>
+    static inline void update_cache(Game* game, const CheckData* check_data) {
+        if (check_data->single_check || check_data->double_check) {
+            game->cold->cache.possible_moves_calculated &= ~get_friendly_pieces<colour>(game);
+        }
+    }
+
+    static inline Bitboard get_en_passant_bitboard(const Game* game) {
+        return game->can_en_passant ? Bitboard(game->en_passant_cell) : Bitboard();
+    }
+
+    // invalidates only the entries that can differ across move, made or undone by colour, so anything else
+    // survives across plies and across undo and redo
+    template <Colour colour>
+    static void update_cache(Game* game, Move move, Bitboard en_passant_before) {
+        Bitboard changed = Bitboard(get_from(move)) | Bitboard(get_to(move));
+        if (get_flag(move) == Move::Flag::EnPassant) {
+            changed |= Bitboard(move_forward<EnemyColour<colour>::colour>(get_to(move)));
+        } else if (get_flag(move) == Move::Flag::Castle) {
+            if (get_to(move) == Bitboard::Index(File::C, rear_rank<colour>())) {
+                changed |= Bitboard(File::A, rear_rank<colour>()) | Bitboard(File::D, rear_rank<colour>());
+            } else {
+                changed |= Bitboard(File::F, rear_rank<colour>()) | Bitboard(File::H, rear_rank<colour>());
+            }
+        }
+
+        // pieces that can reach a changed cell: knights, pawns pushing or capturing onto it, and the kings, whose
+        // moves depend on every enemy attack and on castling rights
+        Bitboard invalid = changed
+            | get_knight_attacks(changed)
+            | get_king_attacks(changed)
+            | move_north(move_north(changed))
+            | move_south(move_south(changed))
+            | *get_friendly_kings<Colour::White>(game)
+            | *get_friendly_kings<Colour::Black>(game);
+
+        // en passant is only available for one ply, so the pawns beside the old and new en passant cells change
+        invalid |= get_king_attacks(en_passant_before | get_en_passant_bitboard(game));
+
+        // sliders seeing a changed cell through cells that did not change, this also covers every pin made or broken,
+        // as the pinned piece is the first piece seen from any changed cell between the king and the pinner
+        const Bitboard occupancy = get_all_pieces(game) & ~changed;
+        for (Bitboard remaining = changed; remaining; remaining.data &= remaining.data - 1) {
+            invalid |= get_queen_attacks(Bitboard::Index(__builtin_ctzll(remaining.data)), occupancy);
+        }
+
+        game->cold->cache.possible_moves_calculated &= ~invalid;
+    }
+
+    // entries are kept across turns, so only the side to move can read or write them
+    template <Colour colour>
+    static inline Bitboard get_moves_checking_cache(Game* game, Bitboard::Index index) {
+        if (!(get_friendly_pieces<colour>(game) & Bitboard(index))) {
+            return Bitboard();
+        }
+
+        if (game->cold->cache.possible_moves_calculated & Bitboard(index)) {
+            return game->cold->cache.possible_moves[U8(index)];
+        }
+
+        const Bitboard result = get_moves<colour>(game, index);
+        game->cold->cache.possible_moves[U8(index)] = result;
+        game->cold->cache.possible_moves_calculated |= Bitboard(index);
+
+        return result;
+    }
+    // #endregion
+
+    template <Colour colour>
+    static void calculate_check_data(Game* game) {
+        const Bitboard kings = *get_friendly_kings<colour>(game);
+        CHESS_ASSERT(__builtin_popcountll(kings.data) == 1);
+        const Bitboard::Index king_index(__builtin_ctzll(kings.data));
+        Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
+
+        CheckData* check_data = get_check_data(game);
+
+        calculate_skewers<colour>(game, check_data);
+
+        check_data->pinned = calculate_pinned<colour>(game, king_index);
+        check_data->enemy_attacks = get_attack_cells<EnemyColour<colour>::colour, true>(game);
+        calculate_checks<colour>(game, check_data, king_index);
+        update_cache<colour>(game, check_data);
 
         // stalemate or checkmate
+        if (check_data->double_check) {
+            // only the king can move out of a double check
+            const Bitboard moves = get_king_legal_moves<colour>(game, king_index);
+            game->cold->cache.possible_moves[king_index.data] = moves;
+            game->cold->cache.possible_moves_calculated |= kings;
+            check_data->has_moves = bool(moves);
+            return;
+        }
+
         Bitboard moves;
         check_data->has_moves = false;
         for (U8 from_index_plus_one = __builtin_ffsll(friendly_pieces.data); from_index_plus_one; from_index_plus_one = __builtin_ffsll(friendly_pieces.data)) {
             const Bitboard::Index from_index(from_index_plus_one - 1);
             const Bitboard from_index_bitboard(from_index);
-            moves = get_moves<colour>(game, from_index);
-            game->cache.possible_moves[from_index.data] = moves;
-            game->cache.possible_moves_calculated |= from_index_bitboard;
+            moves = get_moves_checking_cache<colour>(game, from_index);
             if (moves) {
                 check_data->has_moves = true;
                 break;
@@ -671,100 +588,99 @@ namespace chess { namespace engine {
         }
     }
 
-    template <Colour colour>
-    static inline void update_cache(Game* game) {
-        game->cache.possible_moves_calculated = Bitboard();
-    }
  
-    template <Colour colour>
+    // en passant takes a pawn that is not on the cell moved to, and takes two pawns off the same rank at once, so on top
+    // of the usual pins and checks it can leave the king in check along that rank
+    template <Colour colour, bool in_check>
+    static bool is_en_passant_legal(const Game* game, Bitboard::Index index) {
+        const CheckData* check_data = get_check_data(game);
+        const Bitboard taken_bitboard(game->en_passant_cell);
+        const Bitboard to_bitboard(move_forward<colour>(game->en_passant_cell));
+        if constexpr (in_check) {
+            // either the pawn giving check is taken, or the check is blocked on the cell moved to
+            if (!(check_data->check_resolution_bitboard & (taken_bitboard | to_bitboard))) {
+                return false;
+            }
+        }
+
+        const Bitboard::Index king_index(__builtin_ctzll(get_friendly_kings<colour>(game)->data));
+        if ((Bitboard(index) & check_data->pinned) && !(get_line(king_index, index) & to_bitboard)) {
+            return false;
+        }
+
+        // the line through the king and the taken pawn only holds the taking pawn when they all share a rank
+        const Bitboard rank = get_line(king_index, game->en_passant_cell);
+        if (!(rank & Bitboard(index))) {
+            return true;
+        }
+
+        const Bitboard occupancy = get_all_pieces(game) & ~Bitboard(index) & ~taken_bitboard;
+        const Bitboard enemy_rooks_and_queens = *get_friendly_rooks<EnemyColour<colour>::colour>(game) | *get_friendly_queens<EnemyColour<colour>::colour>(game);
+        return !(get_rook_attacks(king_index, occupancy) & rank & enemy_rooks_and_queens);
+    }
+
+    template <Colour colour, bool in_check>
     static Bitboard get_pawn_legal_moves(Game* game, Bitboard::Index index) {
         const Bitboard index_bitboard(index);
         if (game->can_en_passant) {
             const Bitboard en_passant_move_cell(move_forward<colour>(game->en_passant_cell));
-            const Bitboard attack_cells = get_pawn_attack_cells<colour>(game, index_bitboard);
+            const Bitboard attack_cells = get_pawn_attacks<colour>(index);
             if (en_passant_move_cell & attack_cells) {
-                Bitboard moves = apply_check_evasion_and_prevention<colour>(
+                Bitboard moves = apply_check_evasion_and_prevention<colour, in_check>(
                     game,
-                    index_bitboard,
+                    index,
                     (attack_cells & get_friendly_pieces<EnemyColour<colour>::colour>(game)) | get_pawn_non_attack_moves_excluding_en_passant<colour>(game, index_bitboard));
 
-                if (test_for_check_after_pseudo_legal_move<colour>(game, Move(game, index, move_forward<colour>(game->en_passant_cell)))) {
-                    moves &= ~en_passant_move_cell;
-                } else {
+                if (is_en_passant_legal<colour, in_check>(game, index)) {
                     moves |= en_passant_move_cell;
                 }
                 return moves;
             }
             
-            return apply_check_evasion_and_prevention<colour>(
+            return apply_check_evasion_and_prevention<colour, in_check>(
                 game,
-                index_bitboard, 
+                index,
                 get_pawn_non_attack_moves_excluding_en_passant<colour>(game, index_bitboard) | (attack_cells & get_friendly_pieces<EnemyColour<colour>::colour>(game)));
         }
 
-        return apply_check_evasion_and_prevention<colour>(game, index_bitboard, get_pawn_moves_excluding_en_passant<colour>(game, index_bitboard));
+        return apply_check_evasion_and_prevention<colour, in_check>(game, index, get_pawn_moves_excluding_en_passant<colour>(game, index));
     }
 
-    template <Colour colour>
+    template <Colour colour, bool in_check>
     static Bitboard get_knight_legal_moves(Game* game, Bitboard::Index index) {
         const Bitboard index_bitboard(index);
-        return apply_check_evasion_and_prevention<colour>(game, index_bitboard, get_knight_moves<colour>(game, index_bitboard));
+        return apply_check_evasion_and_prevention<colour, in_check>(game, index, get_knight_moves<colour>(game, index));
     }
 
-    template <Colour colour>
+    template <Colour colour, bool in_check>
     static Bitboard get_bishop_legal_moves(Game* game, Bitboard::Index index) {
         const Bitboard index_bitboard(index);
-        return apply_check_evasion_and_prevention<colour>(game, index_bitboard, get_bishop_moves<colour>(game, index_bitboard));
+        return apply_check_evasion_and_prevention<colour, in_check>(game, index, get_bishop_moves<colour>(game, index_bitboard));
     }
 
-    template <Colour colour>
+    template <Colour colour, bool in_check>
     static Bitboard get_rook_legal_moves(Game* game, Bitboard::Index index) {
         const Bitboard index_bitboard(index);
-        return apply_check_evasion_and_prevention<colour>(game, index_bitboard, get_rook_moves<colour>(game, index_bitboard));
+        return apply_check_evasion_and_prevention<colour, in_check>(game, index, get_rook_moves<colour>(game, index_bitboard));
     }
 
-    template <Colour colour>
+    template <Colour colour, bool in_check>
     static Bitboard get_queen_legal_moves(Game* game, Bitboard::Index index) {
         const Bitboard index_bitboard(index);
-        return apply_check_evasion_and_prevention<colour>(game, index_bitboard, get_queen_moves<colour>(game, index_bitboard));
+        return apply_check_evasion_and_prevention<colour, in_check>(game, index, get_queen_moves<colour>(game, index_bitboard));
     }
 
-    template <Colour colour>
-    static Bitboard apply_check_evasion_and_prevention(const Game* game, Bitboard index_bitboard, Bitboard moves) {
-        const Bitboard other_friendly_pieces = get_friendly_pieces<colour>(game) & ~index_bitboard;
+    // when in_check is false the check resolution bitboard is known to be every cell and is skipped
+    template <Colour colour, bool in_check>
+    static Bitboard apply_check_evasion_and_prevention(const Game* game, Bitboard::Index index, Bitboard moves) {
         const CheckData* check_data = get_check_data(game);
-        moves &= check_data->check_resolution_bitboard;
-
-        if (index_bitboard & check_data->north_skewer && !(other_friendly_pieces & check_data->north_skewer)) {
-            return moves & check_data->north_skewer;
-        }
-
-        if (index_bitboard & check_data->north_east_skewer && !(other_friendly_pieces & check_data->north_east_skewer)) {
-            return moves & check_data->north_east_skewer;
-        }
-
-        if (index_bitboard & check_data->east_skewer && !(other_friendly_pieces & check_data->east_skewer)) {
-            return moves & check_data->east_skewer;
-        }
-
-        if (index_bitboard & check_data->south_east_skewer && !(other_friendly_pieces & check_data->south_east_skewer)) {
-            return moves & check_data->south_east_skewer;
-        }
-
-        if (index_bitboard & check_data->south_skewer && !(other_friendly_pieces & check_data->south_skewer)) {
-            return moves & check_data->south_skewer;
-        }
-
-        if (index_bitboard & check_data->south_west_skewer && !(other_friendly_pieces & check_data->south_west_skewer)) {
-            return moves & check_data->south_west_skewer;
+        if constexpr (in_check) {
+            moves &= check_data->check_resolution_bitboard;
         }
 
-        if (index_bitboard & check_data->west_skewer && !(other_friendly_pieces & check_data->west_skewer)) {
-            return moves & check_data->west_skewer;
-        }
-
-        if (index_bitboard & check_data->north_west_skewer && !(other_friendly_pieces & check_data->north_west_skewer)) {
-            return moves & check_data->north_west_skewer;
+        if (Bitboard(index) & check_data->pinned) {
+            const Bitboard::Index king_index(__builtin_ctzll(get_friendly_kings<colour>(game)->data));
+            return moves & get_line(king_index, index);
         }
 
         return moves;
@@ -775,23 +691,27 @@ namespace chess { namespace engine {
         if constexpr (colour == Colour::Black) {
             if (game->black_can_never_castle_long != x) {
                 game->black_can_never_castle_long = x;
+                game->key ^= get_castle_right_key(CastleRight::BlackLong);
             }
         } else {
             if (game->white_can_never_castle_long != x) {
                 game->white_can_never_castle_long = x;
+                game->key ^= get_castle_right_key(CastleRight::WhiteLong);
             }
         }
     }
 
     template <Colour colour>
-    static inline bool set_can_never_castle_short(Game* game, bool x) {
+    static inline void set_can_never_castle_short(Game* game, bool x) {
         if constexpr (colour == Colour::Black) {
             if (game->black_can_never_castle_short != x) {
                 game->black_can_never_castle_short = x;
+                game->key ^= get_castle_right_key(CastleRight::BlackShort);
             }
         } else {
             if (game->white_can_never_castle_short != x) {
                 game->white_can_never_castle_short = x;
+                game->key ^= get_castle_right_key(CastleRight::WhiteShort);
             }
         }
     }
@@ -814,68 +734,65 @@ namespace chess { namespace engine {
         }
     }
 
-    template <Colour colour, Piece::Type piece_type>
-    static inline void add_friendly_piece(Game* game, Bitboard index_bitboard) {
-        *get_friendly_bitboard<colour, piece_type>(game) |= index_bitboard;
-    }
-
     template <Colour colour>
     static inline void add_friendly_piece(Game* game, Bitboard index_bitboard, Piece::Type piece_type) {
-        if (piece_type == Piece::Type::Pawn) {
-            *get_friendly_pawns<colour>(game) |= index_bitboard;
-        } else if (piece_type == Piece::Type::Knight) {
-            *get_friendly_knights<colour>(game) |= index_bitboard;
-        } else if (piece_type == Piece::Type::Bishop) {
-            *get_friendly_bishops<colour>(game) |= index_bitboard;
-        } else if (piece_type == Piece::Type::Rook) {
-            *get_friendly_rooks<colour>(game) |= index_bitboard;
-        } else if (piece_type == Piece::Type::Queen) {
-            *get_friendly_queens<colour>(game) |= index_bitboard;
-        } else {
-            CHESS_ASSERT(piece_type == Piece::Type::King);
-            *get_friendly_kings<colour>(game) |= index_bitboard;
-        }
+        CHESS_ASSERT(piece_type != Piece::Type::Empty);
+        game->pieces[U8(colour)][get_piece_type_index(piece_type)] |= index_bitboard;
+        game->colour_pieces[U8(colour)] |= index_bitboard;
+        game->key ^= get_piece_key(colour, piece_type, Bitboard::Index(__builtin_ctzll(index_bitboard.data)));
+    }
+
+    template <Colour colour, Piece::Type piece_type>
+    static inline void add_friendly_piece(Game* game, Bitboard index_bitboard) {
+        static_assert(piece_type != Piece::Type::Empty);
+        add_friendly_piece<colour>(game, index_bitboard, piece_type);
     }
 
     static inline void set_can_not_en_passant(Game* game) {
-        game->can_en_passant = false;
+        if (game->can_en_passant) {
+            game->key ^= get_en_passant_key(game->en_passant_cell);
+            game->can_en_passant = false;
+        }
     }
 
     static inline void set_en_passant_cell(Game* game, Bitboard::Index index) {
+        set_can_not_en_passant(game);
         game->can_en_passant = true;
         game->en_passant_cell = index;
+        game->key ^= get_en_passant_key(index);
     }
 
     template <Colour colour>
     static Bitboard get_king_legal_moves(Game* game, Bitboard::Index index) {
         CHESS_ASSERT(has_friendly_king<colour>(game, Bitboard(index)));
-        return get_king_moves<colour>(game, Bitboard(index)) & ~get_attack_cells<EnemyColour<colour>::colour, true>(game);
+        const Bitboard enemy_attacks = get_check_data(game)->enemy_attacks;
+        return get_king_moves<colour>(game, index, enemy_attacks) & ~enemy_attacks;
     }
 
-    template <Colour colour>
+    template <Colour colour, bool in_check>
     static Bitboard get_moves(Game* game, Bitboard::Index index) {
         // non templated get_moves should only call this if there is no cache entry
         Bitboard index_bitboard(index);
-        CHESS_ASSERT(!(game->cache.possible_moves_calculated & index_bitboard));
+        CHESS_ASSERT(!(game->cold->cache.possible_moves_calculated & index_bitboard));
 
         if (has_friendly_pawn<colour>(game, index_bitboard)) {
-            return get_pawn_legal_moves<colour>(game, index);
+            return get_pawn_legal_moves<colour, in_check>(game, index);
         }
         
         if (has_friendly_knight<colour>(game, index_bitboard)) {
-            return get_knight_legal_moves<colour>(game, index);
+            return get_knight_legal_moves<colour, in_check>(game, index);
         }
 
         if (has_friendly_bishop<colour>(game, index_bitboard)) {
-            return get_bishop_legal_moves<colour>(game, index);
+            return get_bishop_legal_moves<colour, in_check>(game, index);
         }
 
         if (has_friendly_rook<colour>(game, index_bitboard)) {
-            return get_rook_legal_moves<colour>(game, index);
+            return get_rook_legal_moves<colour, in_check>(game, index);
         }
 
         if (has_friendly_queen<colour>(game, index_bitboard)) {
-            return get_bishop_legal_moves<colour>(game, index) | get_rook_legal_moves<colour>(game, index);
+            return get_bishop_legal_moves<colour, in_check>(game, index) | get_rook_legal_moves<colour, in_check>(game, index);
         }
 
         if (has_friendly_king<colour>(game, index_bitboard)) {
@@ -886,61 +803,205 @@ namespace chess { namespace engine {
     }
 
     template <Colour colour>
-    static Bitboard get_moves_checking_cache(Game* game, Bitboard::Index index) {
-        if (game->cache.possible_moves_calculated & Bitboard(index)) {
-            return game->cache.possible_moves[U8(index)];
+    static inline Bitboard get_moves(Game* game, Bitboard::Index index) {
+        if (get_check_data(game)->single_check) {
+            return get_moves<colour, true>(game, index);
         }
 
-        const Bitboard result = get_moves<colour>(game, index);
-        game->cache.possible_moves[U8(index)] = result;
-        game->cache.possible_moves_calculated |= Bitboard(index);
-
-        return result;
+        return get_moves<colour, false>(game, index);
     }
 
-    template <Colour colour>
-    static Piece::Type perform_pawn_move(Game* game, Move move) {
-        const Bitboard from_index_bitboard(move.from);
-        const Bitboard to_index_bitboard(move.to);
-        Piece::Type result = Piece::Type::Empty;
+    // #region move generation
+    template <Colour colour, Piece::Type type, bool in_check>
+    static inline Bitboard get_legal_moves_checking_cache(Game* game, Bitboard::Index index) {
+        if (game->cold->cache.possible_moves_calculated & Bitboard(index)) {
+            return game->cold->cache.possible_moves[U8(index)];
+        }
 
-        // remove pawn that is being moved from 'from' cell
-        remove_friendly_piece<colour, Piece::Type::Pawn>(game, from_index_bitboard);
+        Bitboard result;
+        if constexpr (type == Piece::Type::Pawn) {
+            result = get_pawn_legal_moves<colour, in_check>(game, index);
+        } else if constexpr (type == Piece::Type::Knight) {
+            result = get_knight_legal_moves<colour, in_check>(game, index);
+        } else if constexpr (type == Piece::Type::Bishop) {
+            result = get_bishop_legal_moves<colour, in_check>(game, index);
+        } else if constexpr (type == Piece::Type::Rook) {
+            result = get_rook_legal_moves<colour, in_check>(game, index);
+        } else if constexpr (type == Piece::Type::Queen) {
+            result = get_bishop_legal_moves<colour, in_check>(game, index) | get_rook_legal_moves<colour, in_check>(game, index);
+        } else {
+            static_assert(type == Piece::Type::King);
+            result = get_king_legal_moves<colour>(game, index);
+        }
 
-        if (is_rank(from_index_bitboard, move_backward<colour>(front_rank<colour>()))) {
-            // pawn promotion move
+        game->cold->cache.possible_moves[U8(index)] = result;
+        game->cold->cache.possible_moves_calculated |= Bitboard(index);
 
-            // remove enemy piece that is being captured at 'to' cell
-            result = remove_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard);
+        return result;
+    }
 
-            // add promotion piece at 'to' cell
-            const Piece::Type promotion_piece = get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type);
-            CHESS_ASSERT(promotion_piece == Piece::Type::Knight || promotion_piece == Piece::Type::Bishop || promotion_piece == Piece::Type::Rook ||promotion_piece == Piece::Type::Queen);
-            add_friendly_piece<colour>(game, to_index_bitboard, promotion_piece);
+    static inline void add_move(MoveList* move_list, Move move) {
+        CHESS_ASSERT(move_list->count < move_list_capacity);
+        move_list->moves[move_list->count++] = move;
+    }
 
-            // en passant not possible
-            game->can_en_passant = false;
+    template <Colour colour, Piece::Type type, bool in_check, bool promotion = false>
+    static inline void generate_legal_moves(Game* game, MoveList* move_list, Bitboard pieces) {
+        for (; pieces; pieces &= Bitboard(pieces.data - 1)) {
+            const Bitboard::Index from_index(__builtin_ctzll(pieces.data));
 
-            return result;
-        } else {
-            // non promotion pawn move
-            CHESS_ASSERT(get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty);
+            // the one cell a pawn can take en passant on, or the cells a king castles to
+            Bitboard special_moves;
+            Move::Flag special_flag = Move::Flag::None;
+            if constexpr (type == Piece::Type::Pawn && !promotion) {
+                if (game->can_en_passant) {
+                    special_moves = Bitboard(move_forward<colour>(game->en_passant_cell));
+                    special_flag = Move::Flag::EnPassant;
+                }
+            } else if constexpr (type == Piece::Type::King) {
+                if (from_index == Bitboard::Index(File::E, rear_rank<colour>())) {
+                    special_moves = Bitboard(File::C, rear_rank<colour>()) | Bitboard(File::G, rear_rank<colour>());
+                    special_flag = Move::Flag::Castle;
+                }
+            }
 
-            // remove taken piece, considering en passant
-            if (game->can_en_passant && game->en_passant_cell == move_backward<colour>(move.to)) {
-                remove_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Pawn>(game, Bitboard(game->en_passant_cell));
-                result = Piece::Type::Pawn;
-            } else {
-                // remove enemy piece that is being captured at 'to' cell
-                result = remove_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard);
+            for (Bitboard moves = get_legal_moves_checking_cache<colour, type, in_check>(game, from_index); moves; moves &= Bitboard(moves.data - 1)) {
+                const Bitboard::Index to_index(__builtin_ctzll(moves.data));
+                if constexpr (promotion) {
+                    add_move(move_list, Move(from_index, to_index, Piece::Type::Knight));
+                    add_move(move_list, Move(from_index, to_index, Piece::Type::Bishop));
+                    add_move(move_list, Move(from_index, to_index, Piece::Type::Rook));
+                    add_move(move_list, Move(from_index, to_index, Piece::Type::Queen));
+                } else {
+                    add_move(move_list, Move(from_index, to_index, (special_moves & Bitboard(to_index)) ? special_flag : Move::Flag::None));
+                }
             }
+        }
+    }
 
-            // add piece at 'to' cell
-            add_friendly_piece<colour, Piece::Type::Pawn>(game, to_index_bitboard);
+    // not in check, or in single check where in_check restricts every piece but the king to the check resolution bitboard
+    template <Colour colour, bool in_check>
+    static inline void generate_legal_moves_not_in_double_check(Game* game, MoveList* move_list) {
+        // every move of a pawn one step from the front rank is a promotion
+        const Bitboard pawns = *get_friendly_pawns<colour>(game);
+        const Bitboard promoting_pawns = pawns & bitboard_rank[U8(move_backward<colour>(front_rank<colour>()))];
 
-            // update information about en passant
+        generate_legal_moves<colour, Piece::Type::Pawn, in_check, true>(game, move_list, promoting_pawns);
+        generate_legal_moves<colour, Piece::Type::Pawn, in_check>(game, move_list, pawns & ~promoting_pawns);
+        generate_legal_moves<colour, Piece::Type::Knight, in_check>(game, move_list, *get_friendly_knights<colour>(game));
+        generate_legal_moves<colour, Piece::Type::Bishop, in_check>(game, move_list, *get_friendly_bishops<colour>(game));
+        generate_legal_moves<colour, Piece::Type::Rook, in_check>(game, move_list, *get_friendly_rooks<colour>(game));
+        generate_legal_moves<colour, Piece::Type::Queen, in_check>(game, move_list, *get_friendly_queens<colour>(game));
+        generate_legal_moves<colour, Piece::Type::King, in_check>(game, move_list, *get_friendly_kings<colour>(game));
+    }
+
+    template <Colour colour>
+    static inline void generate_legal_moves_in_double_check(Game* game, MoveList* move_list) {
+        // only the king can move out of a double check
+        generate_legal_moves<colour, Piece::Type::King, true>(game, move_list, *get_friendly_kings<colour>(game));
+    }
+
+    template <Colour colour, Piece::Type type, bool in_check, bool promotion = false>
+    static inline U64 count_legal_moves(Game* game, Bitboard pieces) {
+        U64 result = 0;
+        for (; pieces; pieces &= Bitboard(pieces.data - 1)) {
+            const Bitboard::Index from_index(__builtin_ctzll(pieces.data));
+            result += __builtin_popcountll(get_legal_moves_checking_cache<colour, type, in_check>(game, from_index).data);
+        }
+
+        if constexpr (promotion) {
+            // one move for each of knight, bishop, rook and queen
+            return result * 4;
+        }
+
+        return result;
+    }
+
+    template <Colour colour, bool in_check>
+    static inline U64 count_legal_moves_not_in_double_check(Game* game) {
+        const Bitboard pawns = *get_friendly_pawns<colour>(game);
+        const Bitboard promoting_pawns = pawns & bitboard_rank[U8(move_backward<colour>(front_rank<colour>()))];
+
+        return count_legal_moves<colour, Piece::Type::Pawn, in_check, true>(game, promoting_pawns)
+            + count_legal_moves<colour, Piece::Type::Pawn, in_check>(game, pawns & ~promoting_pawns)
+            + count_legal_moves<colour, Piece::Type::Knight, in_check>(game, *get_friendly_knights<colour>(game))
+            + count_legal_moves<colour, Piece::Type::Bishop, in_check>(game, *get_friendly_bishops<colour>(game))
+            + count_legal_moves<colour, Piece::Type::Rook, in_check>(game, *get_friendly_rooks<colour>(game))
+            + count_legal_moves<colour, Piece::Type::Queen, in_check>(game, *get_friendly_queens<colour>(game))
+            + count_legal_moves<colour, Piece::Type::King, in_check>(game, *get_friendly_kings<colour>(game));
+    }
+
+    // the number of moves generate_legal_moves would produce, without writing them anywhere
+    template <Colour colour>
+    static U64 count_legal_moves(Game* game) {
+        const CheckData* check_data = get_check_data(game);
+        if (check_data->double_check) {
+            return count_legal_moves<colour, Piece::Type::King, true>(game, *get_friendly_kings<colour>(game));
+        } else if (check_data->single_check) {
+            return count_legal_moves_not_in_double_check<colour, true>(game);
+        }
+
+        return count_legal_moves_not_in_double_check<colour, false>(game);
+    }
+
+    template <Colour colour>
+    static void generate_legal_moves(Game* game, MoveList* move_list) {
+        move_list->count = 0;
+
+        const CheckData* check_data = get_check_data(game);
+        if (check_data->double_check) {
+            generate_legal_moves_in_double_check<colour>(game, move_list);
+        } else if (check_data->single_check) {
+            generate_legal_moves_not_in_double_check<colour, true>(game, move_list);
+        } else {
+            generate_legal_moves_not_in_double_check<colour, false>(game, move_list);
+        }
+    }
+    // #endregion
+
+    template <Colour colour>
+    static Piece::Type perform_pawn_move(Game* game, Move move) {
+        const Bitboard from_index_bitboard(get_from(move));
+        const Bitboard to_index_bitboard(get_to(move));
+        Piece::Type result = Piece::Type::Empty;
+
+        // remove pawn that is being moved from 'from' cell
+        remove_friendly_piece<colour, Piece::Type::Pawn>(game, from_index_bitboard);
+
+        if (get_flag(move) == Move::Flag::Promotion) {
+            // pawn promotion move
+            CHESS_ASSERT(is_rank(from_index_bitboard, move_backward<colour>(front_rank<colour>())));
+
+            // remove enemy piece that is being captured at 'to' cell
+            result = remove_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard);
+
+            // add promotion piece at 'to' cell
+            add_friendly_piece<colour>(game, to_index_bitboard, get_promotion_piece_type(move));
+
+            // en passant not possible
+            set_can_not_en_passant(game);
+
+            return result;
+        } else {
+            // non promotion pawn move
+            CHESS_ASSERT(!is_rank(from_index_bitboard, move_backward<colour>(front_rank<colour>())));
+
+            // remove taken piece, considering en passant
+            if (get_flag(move) == Move::Flag::EnPassant) {
+                CHESS_ASSERT(game->can_en_passant && game->en_passant_cell == move_backward<colour>(get_to(move)));
+                remove_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Pawn>(game, Bitboard(game->en_passant_cell));
+                result = Piece::Type::Pawn;
+            } else {
+                // remove enemy piece that is being captured at 'to' cell
+                result = remove_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard);
+            }
+
+            // add piece at 'to' cell
+            add_friendly_piece<colour, Piece::Type::Pawn>(game, to_index_bitboard);
+
+            // update information about en passant
             if (to_index_bitboard == move_forward<colour>(move_forward<colour>(from_index_bitboard))) {
-                set_en_passant_cell(game, move.to);
+                set_en_passant_cell(game, get_to(move));
             } else {
                 set_can_not_en_passant(game);
             }
@@ -951,9 +1012,9 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     static Piece::Type perform_king_move(Game* game, Move move) {
-        const Bitboard from_index_bitboard(move.from);
-        const Bitboard to_index_bitboard(move.to);
-        CHESS_ASSERT(get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty);
+        const Bitboard from_index_bitboard(get_from(move));
+        const Bitboard to_index_bitboard(get_to(move));
+        CHESS_ASSERT(get_flag(move) == Move::Flag::None || get_flag(move) == Move::Flag::Castle);
 
         // remove friendly king that is being moved from 'from' cell
         remove_friendly_piece<colour, Piece::Type::King>(game, from_index_bitboard);
@@ -964,8 +1025,8 @@ namespace chess { namespace engine {
         // add friendly king at 'to' cell
         add_friendly_piece<colour, Piece::Type::King>(game, to_index_bitboard);
 
-        if (from_index_bitboard & Bitboard(File::E, rear_rank<colour>())) {
-            // moving from origin cell
+        if (get_flag(move) == Move::Flag::Castle) {
+            CHESS_ASSERT(from_index_bitboard & Bitboard(File::E, rear_rank<colour>()));
 
             if (to_index_bitboard & Bitboard(File::C, rear_rank<colour>())) {
                 // castling queenside
@@ -973,8 +1034,9 @@ namespace chess { namespace engine {
                 const Bitboard rook_to_index_bitboard(File::D, rear_rank<colour>());
                 remove_friendly_piece<colour, Piece::Type::Rook>(game, rook_from_index_bitboard);
                 add_friendly_piece<colour, Piece::Type::Rook>(game, rook_to_index_bitboard);
-            } else if (to_index_bitboard & Bitboard(File::G, rear_rank<colour>())) {
+            } else {
                 // castling kingside
+                CHESS_ASSERT(to_index_bitboard & Bitboard(File::G, rear_rank<colour>()));
                 const Bitboard rook_from_index_bitboard(File::H, rear_rank<colour>());
                 const Bitboard rook_to_index_bitboard(File::F, rear_rank<colour>());
                 remove_friendly_piece<colour, Piece::Type::Rook>(game, rook_from_index_bitboard);
@@ -992,10 +1054,10 @@ namespace chess { namespace engine {
 
     template <Colour colour, Piece::Type piece_type>
     static Piece::Type perform_knight_or_bishop_or_rook_or_queen_move(Game* game, Move move) {
-        const Bitboard from_index_bitboard(move.from);
-        const Bitboard to_index_bitboard(move.to);
+        const Bitboard from_index_bitboard(get_from(move));
+        const Bitboard to_index_bitboard(get_to(move));
         static_assert(piece_type == Piece::Type::Knight || piece_type == Piece::Type::Bishop || piece_type == Piece::Type::Rook || piece_type == Piece::Type::Queen);
-        CHESS_ASSERT(get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty);
+        CHESS_ASSERT(get_flag(move) == Move::Flag::None);
 
         if constexpr (piece_type == Piece::Type::Rook) {
             if (from_index_bitboard & Bitboard(File::A, rear_rank<colour>())
@@ -1023,8 +1085,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     static Piece::Type perform_move(Game* game, Move move) {
-        const Bitboard from_index_bitboard = Bitboard(move.from);
-        const Bitboard to_index_bitboard = Bitboard(move.to);
+        const Bitboard from_index_bitboard = Bitboard(get_from(move));
         Piece::Type result = Piece::Type::Empty;
 
         if (has_friendly_pawn<colour>(game, from_index_bitboard)) {
@@ -1043,192 +1104,174 @@ namespace chess { namespace engine {
         }
 
         if (result == Piece::Type::Rook) {
-            if (move.to == Bitboard::Index(File::A, rear_rank<EnemyColour<colour>::colour>())) {
+            if (get_to(move) == Bitboard::Index(File::A, rear_rank<EnemyColour<colour>::colour>())) {
                 set_can_never_castle_long<EnemyColour<colour>::colour>(game, true);
-            } else if (move.to == Bitboard::Index(File::H, rear_rank<EnemyColour<colour>::colour>())) {
+            } else if (get_to(move) == Bitboard::Index(File::H, rear_rank<EnemyColour<colour>::colour>())) {
                 set_can_never_castle_short<EnemyColour<colour>::colour>(game, true);
             }
         }
 
         game->next_turn = !game->next_turn;
-        update_cache<EnemyColour<colour>::colour>(game);
+        game->key ^= get_black_to_move_key();
 
         return result;
     }
 
-    template <Colour colour>
+    template <Colour colour, CacheUpdate cache_update = CacheUpdate::Clear>
     static inline void move_unchecked(Game* game, Move move) {
-        set_taken_piece_type(&move.compressed_taken_and_promotion_piece_type, perform_move<colour>(game, move));
-        add_move(game, move);
-        next_check_data(game);
+        const Bitboard en_passant_before = get_en_passant_bitboard(game);
+        UndoRecord undo_record = get_undo_record(game);
+        undo_record.taken_piece_type = perform_move<colour>(game, move);
+        add_move(game, move, undo_record);
+        CHESS_ASSERT(game->key == calculate_key(game));
+        game->cold->plies[game->cold->moves_index].key = game->key;
+        if constexpr (cache_update == CacheUpdate::Incremental) {
+            update_cache<colour>(game, move, en_passant_before);
+            update_cache<colour>(game, &game->cold->plies[game->cold->moves_index - 1].check_data);
+        } else {
+            update_cache<colour>(game);
+        }
         calculate_check_data<EnemyColour<colour>::colour>(game);
     }
 
     template <Colour colour>
     static inline bool move(Game* game, Move move) {
-        // assuming move.to and move.from are in bounds, and this could not be a redo
+        // assuming the move's to and from are in bounds, and this could not be a redo
 
-        const Bitboard possible_moves = get_moves(game, move.from);
-        const Bitboard to_index_bitboard = Bitboard(move.to);
+        const Bitboard possible_moves = get_moves(game, get_from(move));
+        const Bitboard to_index_bitboard = Bitboard(get_to(move));
         if (!(possible_moves & to_index_bitboard)) {
             // not a valid move
             return false;
         }
 
-        move_unchecked<colour>(game, move);
+        move_unchecked<colour, CacheUpdate::Incremental>(game, move);
 
         return true;
     }
 
     template <Colour colour>
-    static void unperform_move(Game* game, Move move) {
-        set_can_never_castle_short<Colour::White>(game, move.white_can_never_castle_short);
-        set_can_never_castle_long<Colour::White>(game, move.white_can_never_castle_long);
-        set_can_never_castle_short<Colour::Black>(game, move.black_can_never_castle_short);
-        set_can_never_castle_long<Colour::Black>(game, move.black_can_never_castle_long);
+    static void unperform_move(Game* game, Move move, UndoRecord undo_record) {
+        set_can_never_castle_short<Colour::White>(game, undo_record.white_can_never_castle_short);
+        set_can_never_castle_long<Colour::White>(game, undo_record.white_can_never_castle_long);
+        set_can_never_castle_short<Colour::Black>(game, undo_record.black_can_never_castle_short);
+        set_can_never_castle_long<Colour::Black>(game, undo_record.black_can_never_castle_long);
         game->next_turn = !game->next_turn;
+        game->key ^= get_black_to_move_key();
 
-        if (move.can_en_passant) {
-            CHESS_ASSERT(game->moves_index > 0);
-            set_en_passant_cell(game, game->moves[game->moves_index - 1].to);
+        if (undo_record.can_en_passant) {
+            set_en_passant_cell(game, undo_record.en_passant_cell);
         } else {
             set_can_not_en_passant(game);
         }
 
-        const Bitboard to_index_bitboard = Bitboard(move.to);
-        const Piece::Type taken_piece = get_taken_piece_type(move.compressed_taken_and_promotion_piece_type);
+        const Bitboard from_index_bitboard = Bitboard(get_from(move));
+        const Bitboard to_index_bitboard = Bitboard(get_to(move));
+        const Piece::Type taken_piece = undo_record.taken_piece_type;
+        const Move::Flag flag = get_flag(move);
 
-        if (has_friendly_pawn<colour>(game, to_index_bitboard)) {
-            // remove pawn from where it was moved to
+        if (flag == Move::Flag::Promotion) {
+            // remove the promoted piece, and put the pawn back
+            remove_friendly_piece<colour>(game, to_index_bitboard);
+            add_friendly_piece<colour, Piece::Type::Pawn>(game, from_index_bitboard);
+        } else if (flag == Move::Flag::EnPassant) {
             remove_friendly_piece<colour, Piece::Type::Pawn>(game, to_index_bitboard);
-            // add pawn to where it was moved from (can not be a promotion move, so don't need to consider that)
-            add_friendly_piece<colour, Piece::Type::Pawn>(game, Bitboard(move.from));
-
-            // add taken piece back to where it was taken from, considering en passant, where the piece is taken from a different cell than is moved to by the taking piece
-            if (taken_piece != Piece::Type::Empty) {
-                if (taken_piece == Piece::Type::Pawn) {
-                    if (game->can_en_passant && move.to == move_forward<colour>(game->en_passant_cell)) {
-                        // en passant
-                        const Bitboard index_bitboard(move_forward<EnemyColour<colour>::colour>(move.to));
-                        add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Pawn>(game, index_bitboard);
-                    } else {
-                        add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Pawn>(game, to_index_bitboard);
-                    }
-                } else if (taken_piece == Piece::Type::Knight) {
-                    add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Knight>(game, to_index_bitboard);
-                } else if (taken_piece == Piece::Type::Bishop) {
-                    add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Bishop>(game, to_index_bitboard);
-                } else if (taken_piece == Piece::Type::Rook) {
-                    add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Rook>(game, to_index_bitboard);
+            add_friendly_piece<colour, Piece::Type::Pawn>(game, from_index_bitboard);
+            // the taken pawn was beside the 'from' cell, not on the 'to' cell
+            add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Pawn>(game, Bitboard(move_forward<EnemyColour<colour>::colour>(get_to(move))));
+        } else if (has_friendly_king<colour>(game, to_index_bitboard)) {
+            remove_friendly_piece<colour, Piece::Type::King>(game, to_index_bitboard);
+            add_friendly_piece<colour, Piece::Type::King>(game, from_index_bitboard);
+
+            // if it was a castle move, remove the rook from where it was moved to, and add it where it was moved from
+            if (flag == Move::Flag::Castle) {
+                if (get_to(move) == Bitboard::Index(File::C, rear_rank<colour>())) {
+                    CHESS_ASSERT(*get_friendly_rooks<colour>(game) & Bitboard(File::D, rear_rank<colour>()));
+                    remove_friendly_piece<colour, Piece::Type::Rook>(game, Bitboard(File::D, rear_rank<colour>()));
+                    add_friendly_piece<colour, Piece::Type::Rook>(game, Bitboard(File::A, rear_rank<colour>()));
                 } else {
-                    // king cannot be taken
-                    CHESS_ASSERT(taken_piece == Piece::Type::Queen);
-                    add_friendly_piece<EnemyColour<colour>::colour, Piece::Type::Queen>(game, to_index_bitboard);
+                    CHESS_ASSERT(*get_friendly_rooks<colour>(game) & Bitboard(File::F, rear_rank<colour>()));
+                    remove_friendly_piece<colour, Piece::Type::Rook>(game, Bitboard(File::F, rear_rank<colour>()));
+                    add_friendly_piece<colour, Piece::Type::Rook>(game, Bitboard(File::H, rear_rank<colour>()));
                 }
             }
         } else {
-            if (has_friendly_knight<colour>(game, to_index_bitboard)) {
-                // remove the knight from where it was moved to
-                remove_friendly_piece<colour, Piece::Type::Knight>(game, to_index_bitboard);
-                // add piece to where it was moved from, considering promotion
-                if (get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty) {
-                    add_friendly_piece<colour, Piece::Type::Knight>(game, Bitboard(move.from));
-                } else {
-                    add_friendly_piece<colour, Piece::Type::Pawn>(game, Bitboard(move.from));
-                }
-            } else if (has_friendly_bishop<colour>(game, to_index_bitboard)) {
-                // remove the bishop from where it was moved to
-                remove_friendly_piece<colour, Piece::Type::Bishop>(game, to_index_bitboard);
-                // add piece to where it was moved from, considering promotion
-                if (get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty) {
-                    add_friendly_piece<colour, Piece::Type::Bishop>(game, Bitboard(move.from));
-                } else {
-                    add_friendly_piece<colour, Piece::Type::Pawn>(game, Bitboard(move.from));
-                }
-            } else if (has_friendly_rook<colour>(game, to_index_bitboard)) {
-                // remove the rook from where it was moved to
-                remove_friendly_piece<colour, Piece::Type::Rook>(game, to_index_bitboard);
-                // add piece to where it was moved from, considering promotion
-                if (get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty) {
-                    add_friendly_piece<colour, Piece::Type::Rook>(game, Bitboard(move.from));
-                } else {
-                    add_friendly_piece<colour, Piece::Type::Pawn>(game, Bitboard(move.from));
-                }
-            } else if (has_friendly_queen<colour>(game, to_index_bitboard)) {
-                // remove the queen from where it was moved to
-                remove_friendly_piece<colour, Piece::Type::Queen>(game, to_index_bitboard);
-                // add piece to where it was moved from, considering promotion
-                if (get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) == Piece::Type::Empty) {
-                    add_friendly_piece<colour, Piece::Type::Queen>(game, Bitboard(move.from));
-                } else {
-                    add_friendly_piece<colour, Piece::Type::Pawn>(game, Bitboard(move.from));
-                }
-            } else {
-                // remove the king from where it was moved to
-                remove_friendly_piece<colour, Piece::Type::King>(game, to_index_bitboard);
-                // add king to where it was moved from (can not be a promotion move, so don't need to consider that)
-                add_friendly_piece<colour, Piece::Type::King>(game, Bitboard(move.from));
-
-                // if it was a castle move, remove the rook from where it was moved to, and add it where it was moved from
-                if (move.from == Bitboard::Index(File::E, rear_rank<colour>())) {
-                    if (move.to == Bitboard::Index(File::C, rear_rank<colour>())) {
-                        CHESS_ASSERT(*get_friendly_rooks<colour>(game) & Bitboard(File::D, rear_rank<colour>()));
-                        const Bitboard rook_from_bitboard(File::D, rear_rank<colour>());
-                        const Bitboard rook_to_bitboard(File::A, rear_rank<colour>());
-                        remove_friendly_piece<colour, Piece::Type::Rook>(game, rook_from_bitboard);
-                        add_friendly_piece<colour, Piece::Type::Rook>(game, rook_to_bitboard);
-                    } else if (move.to == Bitboard::Index(File::G, rear_rank<colour>())) {
-                        CHESS_ASSERT(*get_friendly_rooks<colour>(game) & Bitboard(File::F, rear_rank<colour>()));
-                        const Bitboard rook_from_bitboard(File::F, rear_rank<colour>());
-                        const Bitboard rook_to_bitboard(File::H, rear_rank<colour>());
-                        remove_friendly_piece<colour, Piece::Type::Rook>(game, rook_from_bitboard);
-                        add_friendly_piece<colour, Piece::Type::Rook>(game, rook_to_bitboard);
-                    }
-                }
-            }
-
-            // for all pieces except pawn (because pawns need to consider en passant), add the taken piece back to where it was taken from
-            if (taken_piece != Piece::Type::Empty) {
-                add_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard, taken_piece);
-            }
+            // move the piece back to where it was moved from
+            add_friendly_piece<colour>(game, from_index_bitboard, remove_friendly_piece<colour>(game, to_index_bitboard));
         }
 
-        update_cache<colour>(game);
+        // add the taken piece back to where it was taken from, en passant has already been handled
+        if (taken_piece != Piece::Type::Empty && flag != Move::Flag::EnPassant) {
+            add_friendly_piece<EnemyColour<colour>::colour>(game, to_index_bitboard, taken_piece);
+        }
     }
 
-    template <Colour colour>
-    static inline bool undo_unchecked(Game* game) {
-        --game->moves_index;
-        unperform_move<colour>(game, game->moves[game->moves_index]);
-        if (!previous_check_data(game)) {
-            calculate_check_data<colour>(game);
+    template <Colour colour, CacheUpdate cache_update = CacheUpdate::Clear>
+    static inline void undo_unchecked(Game* game) {
+        const Bitboard en_passant_before = get_en_passant_bitboard(game);
+        --game->cold->moves_index;
+        unperform_move<colour>(game, game->cold->moves[game->cold->moves_index], game->cold->plies[game->cold->moves_index].undo_record);
+        CHESS_ASSERT(game->key == game->cold->plies[game->cold->moves_index].key);
+        // the check data of the ply being returned to is still there, so nothing is recalculated
+        if constexpr (cache_update == CacheUpdate::Incremental) {
+            update_cache<colour>(game, game->cold->moves[game->cold->moves_index], en_passant_before);
+            update_cache<EnemyColour<colour>::colour>(game, &game->cold->plies[game->cold->moves_index + 1].check_data);
+            update_cache<colour>(game, get_check_data(game));
+        } else {
+            update_cache<colour>(game);
+        }
+    }
+
+    // copies every field of position into game, leaving the history, check data and cache alone
+    static inline void copy_position(Game* game, const Position* position) {
+        memcpy(game->pieces, position->pieces, sizeof(game->pieces));
+        update_occupancy(game);
+        game->key = position->key;
+        game->en_passant_cell = position->en_passant_cell;
+        game->can_en_passant = position->can_en_passant;
+        game->next_turn = position->next_turn;
+        game->white_can_never_castle_short = position->white_can_never_castle_short;
+        game->white_can_never_castle_long = position->white_can_never_castle_long;
+        game->black_can_never_castle_short = position->black_can_never_castle_short;
+        game->black_can_never_castle_long = position->black_can_never_castle_long;
+    }
+
+    // undo_mode CopyMake puts back position, copied before the move, rather than unperforming the move
+    template <Colour colour, UndoMode undo_mode>
+    static inline void undo_unchecked(Game* game, const Position* position) {
+        if constexpr (undo_mode == UndoMode::CopyMake) {
+            --game->cold->moves_index;
+            copy_position(game, position);
+            update_cache<colour>(game);
+        } else {
+            undo_unchecked<colour>(game);
         }
     }
 
     template <Colour colour>
     static inline bool undo(Game* game) {
-        if (game->moves_index == 0) {
+        if (game->cold->moves_index == 0) {
             return false;
         }
 
-        undo_unchecked<colour>(game);
+        undo_unchecked<colour, CacheUpdate::Incremental>(game);
         return true;
     }
 
     template <Colour colour>
     static Bitboard get_cells_moved_from(const Game* game) {
-        if (game->moves_index != 0) {
-            const Move* move = &game->moves[game->moves_index - 1];
-            const Bitboard to_bitboard = Bitboard(move->to);
-            if (has_friendly_king<EnemyColour<colour>::colour>(game, to_bitboard) && move->from == Bitboard::Index(File::E, front_rank<colour>())) {
-                if (move->to == Bitboard::Index(File::G, front_rank<colour>())) {
+        if (game->cold->moves_index != 0) {
+            const Move* move = &game->cold->moves[game->cold->moves_index - 1];
+            const Bitboard to_bitboard = Bitboard(get_to(*move));
+            if (has_friendly_king<EnemyColour<colour>::colour>(game, to_bitboard) && get_from(*move) == Bitboard::Index(File::E, front_rank<colour>())) {
+                if (get_to(*move) == Bitboard::Index(File::G, front_rank<colour>())) {
                     return nth_bit(Bitboard::Index(File::E, front_rank<colour>()), Bitboard::Index(File::H, front_rank<colour>()));
-                } else if (move->to == Bitboard::Index(File::C, front_rank<colour>())) {
+                } else if (get_to(*move) == Bitboard::Index(File::C, front_rank<colour>())) {
                     return nth_bit(Bitboard::Index(File::E, front_rank<colour>()), Bitboard::Index(File::A, front_rank<colour>()));
                 }
             }
 
-            return Bitboard(move->from);
+            return Bitboard(get_from(*move));
         }
 
         return Bitboard();
@@ -1236,13 +1279,13 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     static Bitboard get_cells_moved_to(const Game* game) {
-        if (game->moves_index != 0) {
-            const Move* move = &game->moves[game->moves_index - 1];
-            const Bitboard to_bitboard = Bitboard(move->to);
-            if (has_friendly_king<EnemyColour<colour>::colour>(game, to_bitboard) && move->from == Bitboard::Index(File::E, front_rank<colour>())) {
-                if (move->to == Bitboard::Index(File::G, front_rank<colour>())) {
+        if (game->cold->moves_index != 0) {
+            const Move* move = &game->cold->moves[game->cold->moves_index - 1];
+            const Bitboard to_bitboard = Bitboard(get_to(*move));
+            if (has_friendly_king<EnemyColour<colour>::colour>(game, to_bitboard) && get_from(*move) == Bitboard::Index(File::E, front_rank<colour>())) {
+                if (get_to(*move) == Bitboard::Index(File::G, front_rank<colour>())) {
                     return to_bitboard | move_west(to_bitboard);
-                } else if (move->to == Bitboard::Index(File::C, front_rank<colour>())) {
+                } else if (get_to(*move) == Bitboard::Index(File::C, front_rank<colour>())) {
                     return to_bitboard | move_east(to_bitboard);
                 }
             }
@@ -1256,39 +1299,93 @@ namespace chess { namespace engine {
 
     // #region Game
     Game::Game()
-        : white_pawns(nth_bit(Bitboard::Index(File::A, Rank::Two), Bitboard::Index(File::B, Rank::Two), Bitboard::Index(File::C, Rank::Two), Bitboard::Index(File::D, Rank::Two), Bitboard::Index(File::E, Rank::Two), Bitboard::Index(File::F, Rank::Two), Bitboard::Index(File::G, Rank::Two), Bitboard::Index(File::H, Rank::Two)))
-        , white_knights(nth_bit(Bitboard::Index(File::B, Rank::One), Bitboard::Index(File::G, Rank::One)))
-        , white_bishops(nth_bit(Bitboard::Index(File::C, Rank::One), Bitboard::Index(File::F, Rank::One)))
-        , white_rooks(nth_bit(Bitboard::Index(File::A, Rank::One), Bitboard::Index(File::H, Rank::One)))
-        , white_queens(Bitboard(File::D, Rank::One))
-        , white_kings(Bitboard(File::E, Rank::One))
-        , black_pawns(nth_bit(Bitboard::Index(File::A, Rank::Seven), Bitboard::Index(File::B, Rank::Seven), Bitboard::Index(File::C, Rank::Seven), Bitboard::Index(File::D, Rank::Seven), Bitboard::Index(File::E, Rank::Seven), Bitboard::Index(File::F, Rank::Seven), Bitboard::Index(File::G, Rank::Seven), Bitboard::Index(File::H, Rank::Seven)))
-        , black_knights(nth_bit(Bitboard::Index(File::B, Rank::Eight), Bitboard::Index(File::G, Rank::Eight)))
-        , black_bishops(nth_bit(Bitboard::Index(File::C, Rank::Eight), Bitboard::Index(File::F, Rank::Eight)))
-        , black_rooks(nth_bit(Bitboard::Index(File::A, Rank::Eight), Bitboard::Index(File::H, Rank::Eight)))
-        , black_queens(Bitboard(File::D, Rank::Eight))
-        , black_kings(Bitboard(File::E, Rank::Eight))
+        : pieces{
+            {
+                nth_bit(Bitboard::Index(File::A, Rank::Two), Bitboard::Index(File::B, Rank::Two), Bitboard::Index(File::C, Rank::Two), Bitboard::Index(File::D, Rank::Two), Bitboard::Index(File::E, Rank::Two), Bitboard::Index(File::F, Rank::Two), Bitboard::Index(File::G, Rank::Two), Bitboard::Index(File::H, Rank::Two)),
+                nth_bit(Bitboard::Index(File::B, Rank::One), Bitboard::Index(File::G, Rank::One)),
+                nth_bit(Bitboard::Index(File::C, Rank::One), Bitboard::Index(File::F, Rank::One)),
+                nth_bit(Bitboard::Index(File::A, Rank::One), Bitboard::Index(File::H, Rank::One)),
+                Bitboard(File::D, Rank::One),
+                Bitboard(File::E, Rank::One)
+            },
+            {
+                nth_bit(Bitboard::Index(File::A, Rank::Seven), Bitboard::Index(File::B, Rank::Seven), Bitboard::Index(File::C, Rank::Seven), Bitboard::Index(File::D, Rank::Seven), Bitboard::Index(File::E, Rank::Seven), Bitboard::Index(File::F, Rank::Seven), Bitboard::Index(File::G, Rank::Seven), Bitboard::Index(File::H, Rank::Seven)),
+                nth_bit(Bitboard::Index(File::B, Rank::Eight), Bitboard::Index(File::G, Rank::Eight)),
+                nth_bit(Bitboard::Index(File::C, Rank::Eight), Bitboard::Index(File::F, Rank::Eight)),
+                nth_bit(Bitboard::Index(File::A, Rank::Eight), Bitboard::Index(File::H, Rank::Eight)),
+                Bitboard(File::D, Rank::Eight),
+                Bitboard(File::E, Rank::Eight)
+            }
+        }
+        , key(0)
         , en_passant_cell(0)
-        , moves_allocated(256)
-        , moves_count(0)
-        , moves_index(0)
-        , moves(static_cast<Move*>(malloc(sizeof(Move) * moves_allocated)))
-        , check_data_head(1)
-        , check_data_index(0)
-        , check_data{}
         , can_en_passant(0)
         , next_turn(0)
         , white_can_never_castle_short(0)
         , white_can_never_castle_long(0)
         , black_can_never_castle_short(0)
         , black_can_never_castle_long(0)
+        , cold(new ColdState)
     {
-        memset(&check_data[check_data_index], 0, sizeof(CheckData));
-        check_data[check_data_index].check_resolution_bitboard = ~Bitboard();
+        cold->moves_index = 0;
+        cold->moves_count = 0;
+        cold->moves_allocated = 256;
+        cold->moves = static_cast<Move*>(malloc(sizeof(Move) * cold->moves_allocated));
+        cold->plies = static_cast<PlyState*>(malloc(sizeof(PlyState) * cold->moves_allocated));
+
+        // calculate_check_data looks up slider attacks, and a Game may be made before attacks.cpp's static initialisers run
+        init_attack_tables();
+        update_occupancy(this);
+        key = calculate_key(this);
+        cold->plies[0].key = key;
+        calculate_check_data<Colour::White>(this);
     }
 
     Game::~Game() {
-        free(moves);
+        free(cold->moves);
+        free(cold->plies);
+        delete cold;
+    }
+
+    template <Colour colour>
+    static U64 calculate_pieces_key(const Game* game) {
+        U64 result = 0;
+        for (U8 type = U8(Piece::Type::Pawn); type <= U8(Piece::Type::King); ++type) {
+            for (Bitboard pieces = *get_friendly_bitboard<colour>(game, Piece::Type(type)); pieces; pieces &= Bitboard(pieces.data - 1)) {
+                result ^= get_piece_key(colour, Piece::Type(type), Bitboard::Index(__builtin_ctzll(pieces.data)));
+            }
+        }
+        return result;
+    }
+
+    U64 calculate_key(const Game* game) {
+        U64 result = calculate_pieces_key<Colour::White>(game) ^ calculate_pieces_key<Colour::Black>(game);
+
+        if (!game->white_can_never_castle_short) {
+            result ^= get_castle_right_key(CastleRight::WhiteShort);
+        }
+
+        if (!game->white_can_never_castle_long) {
+            result ^= get_castle_right_key(CastleRight::WhiteLong);
+        }
+
+        if (!game->black_can_never_castle_short) {
+            result ^= get_castle_right_key(CastleRight::BlackShort);
+        }
+
+        if (!game->black_can_never_castle_long) {
+            result ^= get_castle_right_key(CastleRight::BlackLong);
+        }
+
+        if (game->can_en_passant) {
+            result ^= get_en_passant_key(game->en_passant_cell);
+        }
+
+        if (game->next_turn) {
+            result ^= get_black_to_move_key();
+        }
+
+        return result;
     }
 
     Piece get_piece(const Game* game, Bitboard bitboard) {
@@ -1391,21 +1488,7 @@ namespace chess { namespace engine {
     template <Colour colour, Piece::Type type>
     const Bitboard* get_friendly_bitboard(const Game* game) {
         static_assert(type != Piece::Type::Empty);
-
-        if constexpr (type == Piece::Type::Pawn) {
-            return get_friendly_pawns<colour>(game);
-        } else if constexpr (type == Piece::Type::Knight) {
-            return get_friendly_knights<colour>(game);
-        } else if constexpr (type == Piece::Type::Bishop) {
-            return get_friendly_bishops<colour>(game);
-        } else if constexpr (type == Piece::Type::Rook) {
-            return get_friendly_rooks<colour>(game);
-        } else if constexpr (type == Piece::Type::Queen) {
-            return get_friendly_queens<colour>(game);
-        } else {
-            static_assert(type == Piece::Type::King);
-            return get_friendly_kings<colour>(game);
-        }
+        return &game->pieces[U8(colour)][get_piece_type_index(type)];
     }
 
     template <Colour colour, Piece::Type type>
@@ -1415,28 +1498,8 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     const Bitboard* get_friendly_bitboard(const Game* game, Piece::Type type) {
-        if (type == Piece::Type::Pawn) {
-            return get_friendly_pawns<colour>(game);
-        }
-        
-        if (type == Piece::Type::Knight) {
-            return get_friendly_knights<colour>(game);
-        }
-        
-        if (type == Piece::Type::Bishop) {
-            return get_friendly_bishops<colour>(game);
-        }
-        
-        if (type == Piece::Type::Rook) {
-            return get_friendly_rooks<colour>(game);
-        }
-        
-        if (type == Piece::Type::Queen) {
-            return get_friendly_queens<colour>(game);
-        }
-
-        CHESS_ASSERT(type == Piece::Type::King);
-        return get_friendly_kings<colour>(game);
+        CHESS_ASSERT(type != Piece::Type::Empty);
+        return &game->pieces[U8(colour)][get_piece_type_index(type)];
     }
 
     template <Colour colour>
@@ -1479,20 +1542,44 @@ namespace chess { namespace engine {
     }
 
     Bitboard get_moves(Game* game, Bitboard::Index index) {
-        if (game->cache.possible_moves_calculated & Bitboard(index)) {
-            return game->cache.possible_moves[U8(index)];
+        if (game->next_turn) {
+            return get_moves_checking_cache<Colour::Black>(game, index);
         }
 
-        const Bitboard result = game->next_turn ? get_moves<Colour::Black>(game, index) : get_moves<Colour::White>(game, index);
-        game->cache.possible_moves[U8(index)] = result;
-        game->cache.possible_moves_calculated |= Bitboard(index);
+        return get_moves_checking_cache<Colour::White>(game, index);
+    }
 
-        return result;
+    void generate_legal_moves(Game* game, MoveList* move_list) {
+        if (game->next_turn) {
+            generate_legal_moves<Colour::Black>(game, move_list);
+        } else {
+            generate_legal_moves<Colour::White>(game, move_list);
+        }
+    }
+
+    // the flag of a non promotion move from 'from' to 'to', worked out from the pieces on the board
+    template <Colour colour>
+    static Move::Flag get_move_flag(const Game* game, Bitboard::Index from, Bitboard::Index to) {
+        if (has_friendly_pawn<colour>(game, Bitboard(from)) && game->can_en_passant && to == move_forward<colour>(game->en_passant_cell)) {
+            return Move::Flag::EnPassant;
+        } else if (has_friendly_king<colour>(game, Bitboard(from)) && from == Bitboard::Index(File::E, rear_rank<colour>())
+            && (to == Bitboard::Index(File::C, rear_rank<colour>()) || to == Bitboard::Index(File::G, rear_rank<colour>())))
+        {
+            return Move::Flag::Castle;
+        }
+
+        return Move::Flag::None;
+    }
+
+    template <Colour colour>
+    static bool is_promotion(const Game* game, Bitboard::Index from) {
+        return has_friendly_pawn<colour>(game, Bitboard(from)) && is_rank(Bitboard(from), move_backward<colour>(front_rank<colour>()));
     }
 
     bool move(Game* game, Bitboard::Index from, Bitboard::Index to) {
         if (can_redo(game)) {
-            if (game->moves[game->moves_index].from == from && game->moves[game->moves_index].to == to) {
+            const Move redo_move = game->cold->moves[game->cold->moves_index];
+            if (get_from(redo_move) == from && get_to(redo_move) == to && get_flag(redo_move) != Move::Flag::Promotion) {
                 return redo(game);
             }
         }
@@ -1503,15 +1590,24 @@ namespace chess { namespace engine {
         }
 
         if (game->next_turn) {
-            return move<Colour::Black>(game, Move(game, from, to));
+            if (is_promotion<Colour::Black>(game, from)) {
+                // needs a promotion piece, see move_and_promote
+                return false;
+            }
+            return move<Colour::Black>(game, Move(from, to, get_move_flag<Colour::Black>(game, from, to)));
         }
 
-        return move<Colour::White>(game, Move(game, from, to));
+        if (is_promotion<Colour::White>(game, from)) {
+            // needs a promotion piece, see move_and_promote
+            return false;
+        }
+        return move<Colour::White>(game, Move(from, to, get_move_flag<Colour::White>(game, from, to)));
     }
 
     bool move_and_promote(Game* game, Bitboard::Index from, Bitboard::Index to, Piece::Type promotion_piece) {
         if (can_redo(game)) {
-            if (game->moves[game->moves_index].from == from && game->moves[game->moves_index].to == to && get_promotion_piece_type(game->moves[game->moves_index].compressed_taken_and_promotion_piece_type) == promotion_piece) {
+            const Move redo_move = game->cold->moves[game->cold->moves_index];
+            if (get_from(redo_move) == from && get_to(redo_move) == to && get_promotion_piece_type(redo_move) == promotion_piece) {
                 return redo(game);
             }
         }
@@ -1522,10 +1618,16 @@ namespace chess { namespace engine {
         }
 
         if (game->next_turn) {
-            return move<Colour::Black>(game, Move(game, from, to, promotion_piece));
+            if (!is_promotion<Colour::Black>(game, from)) {
+                return false;
+            }
+            return move<Colour::Black>(game, Move(from, to, promotion_piece));
         }
 
-        return move<Colour::White>(game, Move(game, from, to, promotion_piece));
+        if (!is_promotion<Colour::White>(game, from)) {
+            return false;
+        }
+        return move<Colour::White>(game, Move(from, to, promotion_piece));
     }
 
     bool undo(Game* game) {
@@ -1539,16 +1641,20 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     static inline void redo_unchecked(Game* game) {
-        perform_move<colour>(game, game->moves[game->moves_index]);
-        if (!next_check_data(game)) {
-            calculate_check_data<colour>(game);
-        }
-        ++game->moves_index;
+        // the undo record, key and check data written when the move was first made are all still valid
+        const Bitboard en_passant_before = get_en_passant_bitboard(game);
+        const Move move = game->cold->moves[game->cold->moves_index];
+        perform_move<colour>(game, move);
+        ++game->cold->moves_index;
+        CHESS_ASSERT(game->key == game->cold->plies[game->cold->moves_index].key);
+        update_cache<colour>(game, move, en_passant_before);
+        update_cache<colour>(game, &game->cold->plies[game->cold->moves_index - 1].check_data);
+        update_cache<EnemyColour<colour>::colour>(game, get_check_data(game));
     }
 
     template <Colour colour>
     static inline bool redo(Game* game) {
-        if (game->moves_index < game->moves_count) {
+        if (game->cold->moves_index < game->cold->moves_count) {
             redo_unchecked<colour>(game);
             return true;
         }
@@ -1558,52 +1664,38 @@ namespace chess { namespace engine {
 
     bool redo(Game* game) {
         if (game->next_turn) {
-            redo<Colour::Black>(game);
-        } else {
-            redo<Colour::White>(game);
+            return redo<Colour::Black>(game);
         }
+
+        return redo<Colour::White>(game);
     }
 
     static bool last_move_was_capture(const Game* game) {
-        if (game->moves_index > 0) {
-            const Move move = game->moves[U8(game->moves_index - 1)];
-            return get_taken_piece_type(move.compressed_taken_and_promotion_piece_type) != Piece::Type::Empty;
+        if (game->cold->moves_index > 0) {
+            return game->cold->plies[game->cold->moves_index - 1].undo_record.taken_piece_type != Piece::Type::Empty;
         }
         return false;
     }
 
     template <Colour colour>
     static bool last_move_was_en_passant(const Game* game) {
-        if (game->moves_index > 0) {
-            const Move move = game->moves[U8(game->moves_index - 1)];
-            const Bitboard to_index_bitboard = Bitboard(move.to);
-            if (move.can_en_passant) {
-                CHESS_ASSERT(game->moves_index > 1);
-                Bitboard::Index en_passant_cell = game->moves[game->moves_index - 2].to;
-                if (has_friendly_pawn<colour>(game, to_index_bitboard) && move.to == move_forward<colour>(en_passant_cell)) {
-                    return true;
-                }
-            }
+        if (game->cold->moves_index > 0) {
+            return get_flag(game->cold->moves[game->cold->moves_index - 1]) == Move::Flag::EnPassant;
         }
         return false;
     }
 
     template <Colour colour>
     static bool last_move_was_castles(const Game* game) {
-        if (game->moves_index > 0) {
-            const Move move = game->moves[U8(game->moves_index - 1)];
-            return has_friendly_king<colour>(game, Bitboard(move.to))
-                && move.from == Bitboard::Index(File::E, rear_rank<colour>())
-                && (move.to == Bitboard::Index(File::C, rear_rank<colour>())
-                    || move.to == Bitboard::Index(File::G, rear_rank<colour>()));
+        if (game->cold->moves_index > 0) {
+            return get_flag(game->cold->moves[game->cold->moves_index - 1]) == Move::Flag::Castle;
         }
         return false;
     }
 
     static bool last_move_was_promotion(const Game* game) {
-        if (game->moves_index > 0) {
-            const Move move = game->moves[U8(game->moves_index - 1)];
-            return get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type) != Piece::Type::Empty;
+        if (game->cold->moves_index > 0) {
+            return get_flag(game->cold->moves[game->cold->moves_index - 1]) == Move::Flag::Promotion;
         }
         return false;
     }
@@ -1630,7 +1722,7 @@ namespace chess { namespace engine {
 
     template <Colour colour>
     static bool last_move_was_discovered_check(Game* game) {
-        if (game->moves_index > 0) {
+        if (game->cold->moves_index > 0) {
             if (last_move_was_double_check<colour>(game)) {
                 // NOTE(TB): they don't count it as a discovered check if it was a double check
                 return false;
@@ -1641,11 +1733,11 @@ namespace chess { namespace engine {
                 return false;
             }
 
-            const Move move = game->moves[U8(game->moves_index - 1)];
+            const Move move = game->cold->moves[game->cold->moves_index - 1];
             const CheckData* const check_data = get_check_data(game);
             const Bitboard enemy_pieces = get_friendly_pieces<EnemyColour<colour>::colour>(game);
-            const Bitboard moved_to_bitboard(move.to);
-            const Bitboard moved_from_bitboard(move.from);
+            const Bitboard moved_to_bitboard(get_to(move));
+            const Bitboard moved_from_bitboard(get_from(move));
             // NOTE(TB): checking moved from is in the skewer is necessary because of castling
             return ((check_data->north_skewer && !(check_data->north_skewer & enemy_pieces) && !(check_data->north_skewer & moved_to_bitboard) && (check_data->north_skewer & moved_from_bitboard))
                 || (check_data->north_east_skewer && !(check_data->north_east_skewer & enemy_pieces) && !(check_data->north_east_skewer & moved_to_bitboard) && (check_data->north_east_skewer & moved_from_bitboard))
@@ -1665,18 +1757,7 @@ namespace chess { namespace engine {
         Rank rank = Rank::Eight;
         U8 index = 0;
         bool section_two_had_something = false;
-        game->white_pawns = Bitboard();
-        game->white_knights = Bitboard();
-        game->white_bishops = Bitboard();
-        game->white_rooks = Bitboard();
-        game->white_queens = Bitboard();
-        game->white_kings = Bitboard();
-        game->black_pawns = Bitboard();
-        game->black_knights = Bitboard();
-        game->black_bishops = Bitboard();
-        game->black_rooks = Bitboard();
-        game->black_queens = Bitboard();
-        game->black_kings = Bitboard();
+        memset(game->pieces, 0, sizeof(game->pieces));
         game->black_can_never_castle_long = true;
         game->black_can_never_castle_short = true;
         game->white_can_never_castle_long = true;
@@ -1707,40 +1788,40 @@ namespace chess { namespace engine {
                     }
 
                     if (c == 'p') {
-                        game->black_pawns |= Bitboard(Bitboard::Index(file, rank));
+                        *get_friendly_pawns<Colour::Black>(game) |= Bitboard(Bitboard::Index(file, rank));
                         file = file + 1;
                     } else if (c == 'n') {
-                        game->black_knights |= Bitboard(file, rank);
+                        *get_friendly_knights<Colour::Black>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'b') {
-                        game->black_bishops |= Bitboard(file, rank);
+                        *get_friendly_bishops<Colour::Black>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'r') {
-                        game->black_rooks |= Bitboard(file, rank);
+                        *get_friendly_rooks<Colour::Black>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'q') {
-                        game->black_queens |= Bitboard(file, rank);
+                        *get_friendly_queens<Colour::Black>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'k') {
-                        game->black_kings |= Bitboard(file, rank);
+                        *get_friendly_kings<Colour::Black>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'P') {
-                        game->white_pawns |= Bitboard(file, rank);
+                        *get_friendly_pawns<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'N') {
-                        game->white_knights |= Bitboard(file, rank);
+                        *get_friendly_knights<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'B') {
-                        game->white_bishops |= Bitboard(file, rank);
+                        *get_friendly_bishops<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'R') {
-                        game->white_rooks |= Bitboard(file, rank);
+                        *get_friendly_rooks<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'Q') {
-                        game->white_queens |= Bitboard(file, rank);
+                        *get_friendly_queens<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == 'K') {
-                        game->white_kings |= Bitboard(file, rank);
+                        *get_friendly_kings<Colour::White>(game) |= Bitboard(file, rank);
                         file = file + 1;
                     } else if (c == '1') {
                         file = file + 1;
@@ -1803,35 +1884,34 @@ namespace chess { namespace engine {
             } else if (section == 3) {
                 if (c == '-') {
                     game->can_en_passant = false;
-                    if (fen[index] == ' ') {
-                        ++index;
-                        ++section;
-                    } else {
-                        return false;
-                    }
                 } else if (c == 'a' || c == 'b' || c == 'c' || c == 'd' || c == 'e' || c == 'f' || c == 'g' || c == 'h') {
                     const char r = fen[index];
-                    if (r == '1' || r == '2' || r == '3' || r == '4' || r == '5' || r == '6' || r == '7' || r == '8')  {
+                    // fen gives the cell the pawn skipped, the game stores the cell the pawn moved to
+                    if (r == '3' || r == '6')  {
                         const File file = File(U8(File::A) + (c - 'a'));
-                        const Rank rank = Rank(U8(Rank::One) + (r - '1'));
+                        const Rank rank = r == '3' ? Rank::Four : Rank::Five;
                         game->can_en_passant = true;
                         game->en_passant_cell = Bitboard::Index(file, rank);
-
                         ++index;
-                        if (fen[index] == ' ') {
-                            ++index;
-                            ++section;
-                        } else {
-                            return false;
-                        }
                     } else {
                         return false;
                     }
                 } else {
                     return false;
                 }
+
+                // the halfmove clock and fullmove number are optional
+                if (fen[index] == ' ') {
+                    ++index;
+                } else if (fen[index] != '\0') {
+                    return false;
+                }
+                ++section;
             } else if (section == 4) {
                 if (c == '\0') {
+                    update_occupancy(game);
+                    game->key = calculate_key(game);
+                    game->cold->plies[game->cold->moves_index].key = game->key;
 
                     if (game->next_turn) {
                         update_cache<Colour::Black>(game);
@@ -1844,330 +1924,853 @@ namespace chess { namespace engine {
                     return true;
                 }
 
-                return false;
+                if (!(c == ' ' || (c >= '0' && c <= '9'))) {
+                    return false;
+                }
             }
         }
     }
 
-    template <Colour colour, bool divided = false>
-    static U64 fast_perft(Game* game, U8 depth) {
-        U64 result = 0;
-        Bitboard friendly_pieces_to_process = get_friendly_pieces<colour>(game);
-        Bitboard moves_to_process;
-        for (U8 from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data); from_index_plus_one; from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data)) {
-            const Bitboard::Index from_index(from_index_plus_one - 1);
-            moves_to_process = get_moves_checking_cache<colour>(game, from_index);
-            const Bitboard from_index_bitboard(from_index);
-            friendly_pieces_to_process &= ~from_index_bitboard;
-            if (moves_to_process) {
-                for (U8 to_index_plus_one = __builtin_ffsll(moves_to_process.data); to_index_plus_one; to_index_plus_one = __builtin_ffsll(moves_to_process.data)) {
-                    const Bitboard::Index to_index(to_index_plus_one - 1);
-                    const Bitboard to_index_bitboard(to_index);
-                    moves_to_process &= ~to_index_bitboard;
-                    // TOOD(TB): the if statements about piece type could go outside the loop
-                    if (has_friendly_pawn<colour>(game, from_index_bitboard) && is_rank(to_index, front_rank<colour>())) {
-                        if (depth == 1) {
-                            if constexpr (divided) {
-                                char move_name[6];
-                                string_move(Move(game, from_index, to_index, Piece::Type::Knight), move_name);
-                                std::cout << move_name << " 1" << std::endl;
-
-                                string_move(Move(game, from_index, to_index, Piece::Type::Bishop), move_name);
-                                std::cout << move_name << " 1" << std::endl;
-
-                                string_move(Move(game, from_index, to_index, Piece::Type::Rook), move_name);
-                                std::cout << move_name << " 1" << std::endl;
-
-                                string_move(Move(game, from_index, to_index, Piece::Type::Queen), move_name);
-                                std::cout << move_name << " 1" << std::endl;
-                            }
-                            result += 4;
-                        } else {
-                            {
-                                Move the_move(game, from_index, to_index, Piece::Type::Knight);
-                                move_unchecked<colour>(game, the_move);
-                                if constexpr (divided) {
-                                    char move_name[6];
-                                    U64 temp_result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                    string_move(the_move, move_name);
-                                    std::cout << move_name << " " << temp_result << std::endl;
-                                    result += temp_result;
-                                } else {
-                                    result += fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                }
-                                undo_unchecked<colour>(game);
-                            }
-
-                            {
-                                Move the_move(game, from_index, to_index, Piece::Type::Bishop);
-                                move_unchecked<colour>(game, the_move);
-                                if constexpr (divided) {
-                                    char move_name[6];
-                                    U64 temp_result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                    string_move(the_move, move_name);
-                                    std::cout << move_name << " " << temp_result << std::endl;
-                                    result += temp_result;
-                                } else {
-                                    result += fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                }
-                                undo_unchecked<colour>(game);
-                            }
-
-                            {
-                                Move the_move(game, from_index, to_index, Piece::Type::Rook);
-                                move_unchecked<colour>(game, the_move);
-                                if constexpr (divided) {
-                                    char move_name[6];
-                                    U64 temp_result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                    string_move(the_move, move_name);
-                                    std::cout << move_name << " " << temp_result << std::endl;
-                                    result += temp_result;
-                                } else {
-                                    result += fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                }
-                                undo_unchecked<colour>(game);
-                            }
-
-                            {
-                                Move the_move(game, from_index, to_index, Piece::Type::Queen);
-                                move_unchecked<colour>(game, the_move);
-                                if constexpr (divided) {
-                                    char move_name[6];
-                                    U64 temp_result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                    string_move(the_move, move_name);
-                                    std::cout << move_name << " " << temp_result << std::endl;
-                                    result += temp_result;
-                                } else {
-                                    result += fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                }
-                                undo_unchecked<colour>(game);
-                            }
-                        }
-                    } else {
-                        if (depth == 1) { 
-                            if constexpr (divided) {
-                                char move_name[6];
-                                string_move(Move(game, from_index, to_index), move_name);
-                                std::cout << move_name << " 1" << std::endl;
-                            }
-                            ++result;
-                        } else {
-                            Move the_move(game, from_index, to_index);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                U64 temp_result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << " " << temp_result << std::endl;
-                                result += temp_result;
-                            } else {
-                                result += fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo_unchecked<colour>(game);
-                        }
-                    }
-                }
+    // #region PerftTable
+    PerftTable::PerftTable(U64 size_in_megabytes)
+        : buckets(nullptr)
+        , bucket_count(1)
+    {
+        const U64 max_bucket_count = (std::min(size_in_megabytes, perft_table_max_megabytes) * 1024 * 1024) / sizeof(PerftTableBucket);
+        while (bucket_count * 2 <= max_bucket_count) {
+            bucket_count *= 2;
+        }
+
+        while (bucket_count != 0) {
+            buckets = static_cast<PerftTableBucket*>(aligned_alloc(alignof(PerftTableBucket), sizeof(PerftTableBucket) * bucket_count));
+            if (buckets) {
+                break;
             }
+            bucket_count /= 2;
         }
 
-        return result;
+        clear_perft_table(this);
     }
 
-    template <Colour colour, bool divided>
-    static inline U64 fast_perft_thread_fn(Game* game, U8 depth, Move move) {
-        move_unchecked<colour>(game, move);
-        const U64 result = fast_perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-        if constexpr (divided) {
-            char move_name[6];
-            string_move(move, move_name);
-            std::cout << move_name << ": " << result << std::endl;
+    PerftTable::~PerftTable() {
+        free(buckets);
+    }
+
+    void clear_perft_table(PerftTable* table) {
+        for (U64 i = 0; i < table->bucket_count; ++i) {
+            for (U8 j = 0; j < perft_table_bucket_size; ++j) {
+                table->buckets[i].entries[j].key_xor_data.store(0, std::memory_order_relaxed);
+                table->buckets[i].entries[j].data.store(0, std::memory_order_relaxed);
+            }
         }
-        free(game);
-        return result;
     }
 
-    template <Colour colour, bool divided>
-    static inline U64 fast_perft_multi_threaded(Game* game, U8 depth) {
-        if (depth <= 3) {
-            return fast_perft<colour, divided>(game, depth);
+    static inline PerftTableBucket* get_perft_table_bucket(PerftTable* table, U64 key) {
+        return &table->buckets[key & (table->bucket_count - 1)];
+    }
+
+    static inline bool probe_perft_table(PerftTable* table, U64 key, U8 depth, U64* nodes) {
+        const PerftTableBucket* bucket = get_perft_table_bucket(table, key);
+        for (U8 i = 0; i < perft_table_bucket_size; ++i) {
+            const U64 data = bucket->entries[i].data.load(std::memory_order_relaxed);
+            const U64 key_xor_data = bucket->entries[i].key_xor_data.load(std::memory_order_relaxed);
+            if ((key_xor_data ^ data) == key && U8(data) == depth) {
+                *nodes = data >> 8;
+                return true;
+            }
         }
 
-        std::vector<std::future<U64>> futures;
+        return false;
+    }
 
-        Bitboard friendly_pieces_to_process = get_friendly_pieces<colour>(game);
-        Bitboard moves_to_process;
-        for (U8 from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data); from_index_plus_one; from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data)) {
-            const Bitboard::Index from_index(from_index_plus_one - 1);
-            moves_to_process = get_moves<colour>(game, from_index);
-            const Bitboard from_index_bitboard(from_index);
-            friendly_pieces_to_process &= ~from_index_bitboard;
-            if (moves_to_process) {
-                for (U8 to_index_plus_one = __builtin_ffsll(moves_to_process.data); to_index_plus_one; to_index_plus_one = __builtin_ffsll(moves_to_process.data)) {
-                    const Bitboard::Index to_index(to_index_plus_one - 1);
-                    const Bitboard to_index_bitboard(to_index);
-                    moves_to_process &= ~to_index_bitboard;
-                    if (has_friendly_pawn<colour>(game, from_index_bitboard) && is_rank(to_index, front_rank<colour>())) {
-                        futures.push_back(std::async(std::launch::async, fast_perft_thread_fn<colour, divided>, copy(game), depth, Move(game, from_index, to_index, Piece::Type::Knight)));
-                        futures.push_back(std::async(std::launch::async, fast_perft_thread_fn<colour, divided>, copy(game), depth, Move(game, from_index, to_index, Piece::Type::Bishop)));
-                        futures.push_back(std::async(std::launch::async, fast_perft_thread_fn<colour, divided>, copy(game), depth, Move(game, from_index, to_index, Piece::Type::Rook)));
-                        futures.push_back(std::async(std::launch::async, fast_perft_thread_fn<colour, divided>, copy(game), depth, Move(game, from_index, to_index, Piece::Type::Queen)));
-                    } else {
-                        futures.push_back(std::async(std::launch::async, fast_perft_thread_fn<colour, divided>, copy(game), depth, Move(game, from_index, to_index)));
-                    }
+    static inline void store_perft_table(PerftTable* table, U64 key, U8 depth, U64 nodes) {
+        CHESS_ASSERT(depth != 0 && nodes < (1ULL << 56));
+        PerftTableBucket* bucket = get_perft_table_bucket(table, key);
+
+        // replace the shallowest entry, as it is the cheapest to recompute,
+        // another thread may write the bucket in between, which at worst loses an entry
+        PerftTableEntry* replace = &bucket->entries[0];
+        U8 replace_depth = U8(replace->data.load(std::memory_order_relaxed));
+        for (U8 i = 0; i < perft_table_bucket_size; ++i) {
+            PerftTableEntry* entry = &bucket->entries[i];
+            const U64 entry_data = entry->data.load(std::memory_order_relaxed);
+            if (entry_data == 0 || ((entry->key_xor_data.load(std::memory_order_relaxed) ^ entry_data) == key && U8(entry_data) == depth)) {
+                replace = entry;
+                break;
+            }
+
+            if (U8(entry_data) < replace_depth) {
+                replace = entry;
+                replace_depth = U8(entry_data);
+            }
+        }
+
+        const U64 data = (nodes << 8) | depth;
+        replace->key_xor_data.store(key ^ data, std::memory_order_relaxed);
+        replace->data.store(data, std::memory_order_relaxed);
+    }
+    // #endregion
+
+    template <Colour colour, bool divided = false, bool bulk_count = false, UndoMode undo_mode = UndoMode::MakeUnmake>
+    static U64 fast_perft(Game* game, U8 depth, PerftTable* table = nullptr) {
+        if constexpr (bulk_count && !divided) {
+            if (depth == 1) {
+                return count_legal_moves<colour>(game);
+            }
+        }
+
+        if constexpr (!divided) {
+            U64 nodes;
+            if (table && depth > 1 && probe_perft_table(table, game->key, depth, &nodes)) {
+                return nodes;
+            }
+        }
+
+        MoveList move_list;
+        generate_legal_moves<colour>(game, &move_list);
+
+        if (depth == 1) {
+            if constexpr (divided) {
+                for (U16 i = 0; i < move_list.count; ++i) {
+                    char move_name[6];
+                    string_move(move_list.moves[i], move_name);
+                    std::cout << move_name << " 1" << std::endl;
                 }
             }
+            return move_list.count;
+        }
+
+        Position position;
+        if constexpr (undo_mode == UndoMode::CopyMake) {
+            position = get_position(game);
         }
 
         U64 result = 0;
+        for (U16 i = 0; i < move_list.count; ++i) {
+            const Move the_move = move_list.moves[i];
+            move_unchecked<colour>(game, the_move);
+            if constexpr (divided) {
+                char move_name[6];
+                U64 temp_result = fast_perft<EnemyColour<colour>::colour, false, bulk_count, undo_mode>(game, depth - 1, table);
+                string_move(the_move, move_name);
+                std::cout << move_name << " " << temp_result << std::endl;
+                result += temp_result;
+            } else {
+                result += fast_perft<EnemyColour<colour>::colour, false, bulk_count, undo_mode>(game, depth - 1, table);
+            }
+            undo_unchecked<colour, undo_mode>(game, &position);
+        }
 
-        for (U8 i = 0; i < futures.size(); ++i) {
-            result += futures[i].get();
+        if (table) {
+            store_perft_table(table, game->key, depth, result);
         }
 
         return result;
     }
 
-    template <bool divided>
-    U64 fast_perft_multi_threaded(Game* game, U8 depth) {
-        if (game->next_turn) {
-            return fast_perft_multi_threaded<Colour::Black, divided>(game, depth);
-        }
+    // #region gives check
+    template <Colour colour>
+    static inline CheckSquares calculate_check_squares(const Game* game) {
+        const Bitboard friendly_pieces = get_friendly_pieces<colour>(game);
+        const Bitboard all_pieces = get_all_pieces(game);
+        const Bitboard::Index enemy_king_index(__builtin_ctzll(get_friendly_kings<EnemyColour<colour>::colour>(game)->data));
+
+        CheckSquares result;
+        result.enemy_king_index = enemy_king_index;
+        result.pawn = get_pawn_attacks<EnemyColour<colour>::colour>(enemy_king_index);
+        result.knight = get_knight_attacks(enemy_king_index);
+        result.bishop = get_bishop_attacks(enemy_king_index, all_pieces);
+        result.rook = get_rook_attacks(enemy_king_index, all_pieces);
+        result.discoverers = calculate_blockers(
+            enemy_king_index,
+            all_pieces,
+            friendly_pieces,
+            *get_friendly_rooks<colour>(game) | *get_friendly_queens<colour>(game),
+            *get_friendly_bishops<colour>(game) | *get_friendly_queens<colour>(game)
+        );
+        return result;
+    }
 
-        return fast_perft_multi_threaded<Colour::White, divided>(game, depth);
+    static inline bool is_discovered_check(const CheckSquares* check_squares, Bitboard::Index from, Bitboard::Index to) {
+        return (check_squares->discoverers & Bitboard(from)) && !(get_line(check_squares->enemy_king_index, from) & Bitboard(to));
     }
 
-    template U64 fast_perft_multi_threaded<false>(Game* game, U8 depth);
-    template U64 fast_perft_multi_threaded<true>(Game* game, U8 depth);
+    // any of the sliders attack the king through occupancy, for moves that change more than the from and to cells
+    static inline bool is_slider_check(Bitboard::Index king_index, Bitboard occupancy, Bitboard rooks_and_queens, Bitboard bishops_and_queens) {
+        return (get_rook_attacks(king_index, occupancy) & rooks_and_queens) || (get_bishop_attacks(king_index, occupancy) & bishops_and_queens);
+    }
 
-    template <bool divided>
-    U64 fast_perft(Game* game, U8 depth) {
-        if (depth == 0) {
-            return 1;
+    // type is the type of the piece on from, promotion_piece_type is Empty if the move is not a promotion
+    template <Colour colour>
+    static bool gives_check(const Game* game, const CheckSquares* check_squares, Bitboard::Index from, Bitboard::Index to, Piece::Type type, Piece::Type promotion_piece_type) {
+        const Bitboard from_bitboard(from);
+        const Bitboard to_bitboard(to);
+        const Bitboard::Index king_index = check_squares->enemy_king_index;
+
+        if (type == Piece::Type::Pawn) {
+            if (promotion_piece_type != Piece::Type::Empty) {
+                // the pawn may have been the piece blocking the promoted piece's line to the king
+                const Bitboard occupancy = (get_all_pieces(game) & ~from_bitboard) | to_bitboard;
+                Bitboard attacks;
+                if (promotion_piece_type == Piece::Type::Knight) {
+                    attacks = get_knight_attacks(to);
+                } else if (promotion_piece_type == Piece::Type::Bishop) {
+                    attacks = get_bishop_attacks(to, occupancy);
+                } else if (promotion_piece_type == Piece::Type::Rook) {
+                    attacks = get_rook_attacks(to, occupancy);
+                } else {
+                    attacks = get_queen_attacks(to, occupancy);
+                }
+                return (attacks & Bitboard(king_index)) || is_discovered_check(check_squares, from, to);
+            }
+
+            if (game->can_en_passant && to == move_forward<colour>(game->en_passant_cell)) {
+                // the captured pawn leaves the board too, which can uncover a slider on a line the moving pawn was not on
+                const Bitboard occupancy = (get_all_pieces(game) & ~from_bitboard & ~Bitboard(game->en_passant_cell)) | to_bitboard;
+                return (check_squares->pawn & to_bitboard) || is_slider_check(
+                    king_index,
+                    occupancy,
+                    *get_friendly_rooks<colour>(game) | *get_friendly_queens<colour>(game),
+                    *get_friendly_bishops<colour>(game) | *get_friendly_queens<colour>(game)
+                );
+            }
+
+            return (check_squares->pawn & to_bitboard) || is_discovered_check(check_squares, from, to);
+        } else if (type == Piece::Type::Knight) {
+            return (check_squares->knight & to_bitboard) || is_discovered_check(check_squares, from, to);
+        } else if (type == Piece::Type::Bishop) {
+            return (check_squares->bishop & to_bitboard) || is_discovered_check(check_squares, from, to);
+        } else if (type == Piece::Type::Rook) {
+            return (check_squares->rook & to_bitboard) || is_discovered_check(check_squares, from, to);
+        } else if (type == Piece::Type::Queen) {
+            return ((check_squares->bishop | check_squares->rook) & to_bitboard) || is_discovered_check(check_squares, from, to);
+        }
+
+        CHESS_ASSERT(type == Piece::Type::King);
+        if (from == Bitboard::Index(File::E, rear_rank<colour>()) && (to == Bitboard::Index(File::C, rear_rank<colour>()) || to == Bitboard::Index(File::G, rear_rank<colour>()))) {
+            // castling, the rook can give check, or the king can uncover one by leaving its rank
+            const bool short_castle = to == Bitboard::Index(File::G, rear_rank<colour>());
+            const Bitboard rook_from(short_castle ? File::H : File::A, rear_rank<colour>());
+            const Bitboard rook_to(short_castle ? File::F : File::D, rear_rank<colour>());
+            const Bitboard occupancy = (get_all_pieces(game) & ~from_bitboard & ~rook_from) | to_bitboard | rook_to;
+            return is_slider_check(
+                king_index,
+                occupancy,
+                (*get_friendly_rooks<colour>(game) & ~rook_from) | rook_to | *get_friendly_queens<colour>(game),
+                *get_friendly_bishops<colour>(game) | *get_friendly_queens<colour>(game)
+            );
         }
 
+        return is_discovered_check(check_squares, from, to);
+    }
+
+    CheckSquares get_check_squares(const Game* game) {
         if (game->next_turn) {
-            return fast_perft<Colour::Black, divided>(game, depth);
+            return calculate_check_squares<Colour::Black>(game);
         }
 
-        return fast_perft<Colour::White, divided>(game, depth);
+        return calculate_check_squares<Colour::White>(game);
+    }
+
+    bool gives_check(const Game* game, const CheckSquares* check_squares, Move move) {
+        const Piece piece = get_piece(game, Bitboard(get_from(move)));
+        CHESS_ASSERT(piece.type != Piece::Type::Empty && piece.colour == (game->next_turn ? Colour::Black : Colour::White));
+        if (game->next_turn) {
+            return gives_check<Colour::Black>(game, check_squares, get_from(move), get_to(move), piece.type, get_promotion_piece_type(move));
+        }
+
+        return gives_check<Colour::White>(game, check_squares, get_from(move), get_to(move), piece.type, get_promotion_piece_type(move));
+    }
+
+    bool gives_check(const Game* game, Move move) {
+        const CheckSquares check_squares = get_check_squares(game);
+        return gives_check(game, &check_squares, move);
+    }
+    // #endregion
+
+    // #region leaf statistics
+    // the statistics of the position after the last move, colour is the side to move
+    template <Colour colour>
+    static inline PerftResult get_leaf_statistics(Game* game) {
+        return PerftResult{
+            1,
+            last_move_was_capture(game) ? 1ULL : 0ULL,
+            last_move_was_en_passant<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
+            last_move_was_castles<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
+            last_move_was_promotion(game) ? 1ULL : 0ULL,
+            last_move_was_check(game) ? 1ULL : 0ULL,
+            last_move_was_discovered_check<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
+            last_move_was_double_check<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
+            test_for_check_mate<colour>(game) ? 1ULL : 0ULL
+        };
+    }
+
+    template <Colour colour>
+    static inline void add_made_move_statistics(Game* game, Move move, PerftResult* result) {
+        move_unchecked<colour>(game, move);
+        *result = *result + get_leaf_statistics<EnemyColour<colour>::colour>(game);
+        undo_unchecked<colour>(game);
     }
 
-    template U64 fast_perft<false>(Game* game, U8 depth);
-    template U64 fast_perft<true>(Game* game, U8 depth);
+    // a move that does not give check only adds to nodes, captures, en passant, castles and promotions,
+    // so those are counted set-wise, only checking moves are made to find out what sort of check they are
+    template <Colour colour, Piece::Type type, bool in_check, bool promotion = false>
+    static inline void add_leaf_statistics(Game* game, const CheckSquares* check_squares, Bitboard pieces, PerftResult* result) {
+        const Bitboard enemy_pieces = get_friendly_pieces<EnemyColour<colour>::colour>(game);
+        for (; pieces; pieces &= Bitboard(pieces.data - 1)) {
+            const Bitboard::Index from_index(__builtin_ctzll(pieces.data));
+            const Bitboard moves = get_legal_moves_checking_cache<colour, type, in_check>(game, from_index);
+
+            if constexpr (promotion) {
+                for (Bitboard to = moves; to; to &= Bitboard(to.data - 1)) {
+                    const Bitboard::Index to_index(__builtin_ctzll(to.data));
+                    for (Piece::Type promotion_piece_type : {Piece::Type::Knight, Piece::Type::Bishop, Piece::Type::Rook, Piece::Type::Queen}) {
+                        if (gives_check<colour>(game, check_squares, from_index, to_index, type, promotion_piece_type)) {
+                            add_made_move_statistics<colour>(game, Move(from_index, to_index, promotion_piece_type), result);
+                        } else {
+                            ++result->nodes;
+                            ++result->promotions;
+                            result->captures += bool(enemy_pieces & Bitboard(to_index));
+                        }
+                    }
+                }
+                continue;
+            }
+
+            // moves with more than a from and to cell, each checked on its own
+            Bitboard special_moves;
+            if constexpr (type == Piece::Type::Pawn) {
+                if (game->can_en_passant) {
+                    special_moves = moves & Bitboard(move_forward<colour>(game->en_passant_cell));
+                }
+            } else if constexpr (type == Piece::Type::King) {
+                if (from_index == Bitboard::Index(File::E, rear_rank<colour>())) {
+                    special_moves = moves & (Bitboard(File::C, rear_rank<colour>()) | Bitboard(File::G, rear_rank<colour>()));
+                }
+            }
+
+            for (Bitboard to = special_moves; to; to &= Bitboard(to.data - 1)) {
+                const Bitboard::Index to_index(__builtin_ctzll(to.data));
+                if (gives_check<colour>(game, check_squares, from_index, to_index, type, Piece::Type::Empty)) {
+                    add_made_move_statistics<colour>(game, Move(from_index, to_index, type == Piece::Type::Pawn ? Move::Flag::EnPassant : Move::Flag::Castle), result);
+                } else {
+                    ++result->nodes;
+                    if constexpr (type == Piece::Type::Pawn) {
+                        ++result->captures;
+                        ++result->en_passant;
+                    } else {
+                        ++result->castles;
+                    }
+                }
+            }
+
+            Bitboard checking_moves;
+            if constexpr (type == Piece::Type::Pawn) {
+                checking_moves = check_squares->pawn;
+            } else if constexpr (type == Piece::Type::Knight) {
+                checking_moves = check_squares->knight;
+            } else if constexpr (type == Piece::Type::Bishop) {
+                checking_moves = check_squares->bishop;
+            } else if constexpr (type == Piece::Type::Rook) {
+                checking_moves = check_squares->rook;
+            } else if constexpr (type == Piece::Type::Queen) {
+                checking_moves = check_squares->bishop | check_squares->rook;
+            }
+            if (check_squares->discoverers & Bitboard(from_index)) {
+                checking_moves |= ~get_line(check_squares->enemy_king_index, from_index);
+            }
+            checking_moves &= moves & ~special_moves;
+
+            const Bitboard counted_moves = moves & ~special_moves & ~checking_moves;
+            result->nodes += __builtin_popcountll(counted_moves.data);
+            result->captures += __builtin_popcountll((counted_moves & enemy_pieces).data);
+
+            for (Bitboard to = checking_moves; to; to &= Bitboard(to.data - 1)) {
+                add_made_move_statistics<colour>(game, Move(from_index, Bitboard::Index(__builtin_ctzll(to.data))), result);
+            }
+        }
+    }
+
+    template <Colour colour, bool in_check>
+    static inline void add_leaf_statistics_not_in_double_check(Game* game, const CheckSquares* check_squares, PerftResult* result) {
+        const Bitboard pawns = *get_friendly_pawns<colour>(game);
+        const Bitboard promoting_pawns = pawns & bitboard_rank[U8(move_backward<colour>(front_rank<colour>()))];
+
+        add_leaf_statistics<colour, Piece::Type::Pawn, in_check, true>(game, check_squares, promoting_pawns, result);
+        add_leaf_statistics<colour, Piece::Type::Pawn, in_check>(game, check_squares, pawns & ~promoting_pawns, result);
+        add_leaf_statistics<colour, Piece::Type::Knight, in_check>(game, check_squares, *get_friendly_knights<colour>(game), result);
+        add_leaf_statistics<colour, Piece::Type::Bishop, in_check>(game, check_squares, *get_friendly_bishops<colour>(game), result);
+        add_leaf_statistics<colour, Piece::Type::Rook, in_check>(game, check_squares, *get_friendly_rooks<colour>(game), result);
+        add_leaf_statistics<colour, Piece::Type::Queen, in_check>(game, check_squares, *get_friendly_queens<colour>(game), result);
+        add_leaf_statistics<colour, Piece::Type::King, in_check>(game, check_squares, *get_friendly_kings<colour>(game), result);
+    }
+
+    // what perft at depth 1 returns, without making most of the moves
+    template <Colour colour>
+    static PerftResult get_leaf_statistics_of_moves(Game* game) {
+        const CheckSquares check_squares = calculate_check_squares<colour>(game);
+        PerftResult result{};
+
+        const CheckData* check_data = get_check_data(game);
+        if (check_data->double_check) {
+            add_leaf_statistics<colour, Piece::Type::King, true>(game, &check_squares, *get_friendly_kings<colour>(game), &result);
+        } else if (check_data->single_check) {
+            add_leaf_statistics_not_in_double_check<colour, true>(game, &check_squares, &result);
+        } else {
+            add_leaf_statistics_not_in_double_check<colour, false>(game, &check_squares, &result);
+        }
+
+        return result;
+    }
+    // #endregion
 
     template <Colour colour, bool divided = false>
     static PerftResult perft(Game* game, U8 depth) {
         if (depth == 0) {
-            return PerftResult{
-                1,
-                last_move_was_capture(game) ? 1ULL : 0ULL,
-                last_move_was_en_passant<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
-                last_move_was_castles<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
-                last_move_was_promotion(game) ? 1ULL : 0ULL,
-                last_move_was_check(game) ? 1ULL : 0ULL,
-                last_move_was_discovered_check<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
-                last_move_was_double_check<EnemyColour<colour>::colour>(game) ? 1ULL : 0ULL,
-                test_for_check_mate<colour>(game) ? 1ULL : 0ULL
-            };
+            return get_leaf_statistics<colour>(game);
+        }
+
+        if constexpr (!divided) {
+            if (depth == 1) {
+                return get_leaf_statistics_of_moves<colour>(game);
+            }
         }
 
         PerftResult result{};
 
-        Bitboard friendly_pieces_to_process = get_friendly_pieces<colour>(game);
-        Bitboard moves_to_process;
-        for (U8 from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data); from_index_plus_one; from_index_plus_one = __builtin_ffsll(friendly_pieces_to_process.data)) {
-            const Bitboard::Index from_index(from_index_plus_one - 1);
-            moves_to_process = get_moves_checking_cache<colour>(game, from_index);
-            const Bitboard from_index_bitboard(from_index);
-            friendly_pieces_to_process &= ~from_index_bitboard;
-            if (moves_to_process) {
-                for (U8 to_index_plus_one = __builtin_ffsll(moves_to_process.data); to_index_plus_one; to_index_plus_one = __builtin_ffsll(moves_to_process.data)) {
-                    const Bitboard::Index to_index(to_index_plus_one - 1);
-                    const Bitboard to_index_bitboard(to_index);
-                    moves_to_process &= ~to_index_bitboard;
-                    if (has_friendly_pawn<colour>(game, from_index_bitboard) && is_rank(to_index, front_rank<colour>())) {
-                        {
-                            Move the_move(game, from_index, to_index, Piece::Type::Knight);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << ": " << this_result.nodes << std::endl;
-                                result = result + this_result;
-                            } else {
-                                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo(game);
-                        }
+        MoveList move_list;
+        generate_legal_moves<colour>(game, &move_list);
+        for (U16 i = 0; i < move_list.count; ++i) {
+            const Move the_move = move_list.moves[i];
+            move_unchecked<colour>(game, the_move);
+            if constexpr (divided) {
+                char move_name[6];
+                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
+                string_move(the_move, move_name);
+                std::cout << move_name << ": " << this_result.nodes << std::endl;
+                result = result + this_result;
+            } else {
+                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
+            }
+            undo_unchecked<colour>(game);
+        }
 
-                        {
-                            Move the_move(game, from_index, to_index, Piece::Type::Bishop);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << ": " << this_result.nodes << std::endl;
-                                result = result + this_result;
-                            } else {
-                                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo(game);
-                        }
+        return result;
+    }
 
-                        {
-                            Move the_move(game, from_index, to_index, Piece::Type::Rook);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << ": " << this_result.nodes << std::endl;
-                                result = result + this_result;
-                            } else {
-                                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo(game);
-                        }
+    // #region PerftThreadPool
+    // tasks with this depth or less are never split, they are over too quickly to be worth handing to another worker
+    static constexpr U8 perft_min_split_depth = 3;
+
+    struct PerftWorker;
+
+    // a worker's deque never grows past this, a worker whose deque is too full to split a task searches it itself
+    static constexpr U32 perft_task_capacity = 1024;
+
+    // a worker with this many splits still waiting on their children searches its tasks itself until one finishes
+    static constexpr U32 perft_split_capacity = 256;
+
+    // the totals of one root move, added to by every task under it that is not a child of a split, and by the splits
+    // directly under it as they finish
+    struct PerftTaskResult {
+        void add(const PerftResult& result) {
+            nodes += result.nodes;
+            captures += result.captures;
+            en_passant += result.en_passant;
+            castles += result.castles;
+            promotions += result.promotions;
+            checks += result.checks;
+            discovery_checks += result.discovery_checks;
+            double_checks += result.double_checks;
+            checkmates += result.checkmates;
+        }
+
+        PerftResult get() const {
+            return PerftResult{nodes, captures, en_passant, castles, promotions, checks, discovery_checks, double_checks, checkmates};
+        }
+
+        std::atomic<U64> nodes;
+        std::atomic<U64> captures;
+        std::atomic<U64> en_passant;
+        std::atomic<U64> castles;
+        std::atomic<U64> promotions;
+        std::atomic<U64> checks;
+        std::atomic<U64> discovery_checks;
+        std::atomic<U64> double_checks;
+        std::atomic<U64> checkmates;
+    };
+
+    // a task that was split into a task per move, its children add their node counts to nodes, and the last of them to
+    // finish stores the total in the table and passes it on to the split's own parent
+    struct PerftSplit {
+        U64 key;
+        U8 depth;
+        PerftSplit* parent;
+        // the worker whose free list this goes back to
+        PerftWorker* owner;
+        // the next split in owner's free list while this one is free
+        PerftSplit* next_free;
+        std::atomic<U64> nodes;
+        std::atomic<U16> pending_count;
+    };
+
+    struct PerftTask {
+        Position position;
+        U8 depth;
+        PerftTaskResult* result;
+        // the split this task is a child of, nullptr for the root moves and for detailed tasks, which add to result
+        PerftSplit* split;
+        void (*run)(PerftWorker* worker, PerftTask task);
+    };
+
+    struct PerftWorker {
+        PerftThreadPoolState* state;
+        U32 index;
+        // allocated once with the pool, every task this worker runs is loaded into it with set_position
+        Game game;
+        // a ring buffer, the owner pushes and pops at the back, thieves take from the front where the larger subtrees are
+        std::mutex mutex;
+        PerftTask tasks[perft_task_capacity];
+        U32 tasks_begin;
+        U32 tasks_count;
+        // taken from by this worker when it splits a task, given back by the worker that finishes the split's last child,
+        // free_splits is guarded by mutex
+        PerftSplit splits[perft_split_capacity];
+        PerftSplit* free_splits;
+        std::thread thread;
+    };
+
+    struct PerftThreadPoolState {
+        std::vector<std::unique_ptr<PerftWorker>> workers;
+        std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable job_done;
+        // only one perft runs on a pool at a time
+        std::mutex job_mutex;
+        PerftTable* table = nullptr;
+        // tasks sitting in a deque
+        std::atomic<U64> queued_count{0};
+        // tasks queued or running, the job is done when this reaches 0
+        std::atomic<U64> pending_count{0};
+        std::atomic<U32> idle_count{0};
+        bool stop = false;
+    };
+
+    static void push_tasks(PerftWorker* worker, const PerftTask* tasks, U16 count) {
+        PerftThreadPoolState* state = worker->state;
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            CHESS_ASSERT(worker->tasks_count + count <= perft_task_capacity);
+            for (U16 i = 0; i < count; ++i) {
+                worker->tasks[(worker->tasks_begin + worker->tasks_count) % perft_task_capacity] = tasks[i];
+                ++worker->tasks_count;
+            }
+        }
 
-                        {
-                            Move the_move(game, from_index, to_index, Piece::Type::Queen);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << ": " << this_result.nodes << std::endl;
-                                result = result + this_result;
-                            } else {
-                                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo(game);
-                        }
-                    } else {
-                        {
-                            Move the_move(game, from_index, to_index);
-                            move_unchecked<colour>(game, the_move);
-                            if constexpr (divided) {
-                                char move_name[6];
-                                PerftResult this_result = perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                                string_move(the_move, move_name);
-                                std::cout << move_name << ": " << this_result.nodes << std::endl;
-                                result = result + this_result;
-                            } else {
-                                result = result + perft<EnemyColour<colour>::colour, false>(game, depth - 1);
-                            }
-                            undo(game);
-                        }
-                    }
+        state->queued_count += count;
+        if (state->idle_count > 0) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->work_available.notify_all();
+        }
+    }
+
+    static bool pop_task(PerftWorker* worker, PerftTask* task) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (worker->tasks_count == 0) {
+            return false;
+        }
+
+        --worker->tasks_count;
+        *task = worker->tasks[(worker->tasks_begin + worker->tasks_count) % perft_task_capacity];
+        --worker->state->queued_count;
+        return true;
+    }
+
+    static bool steal_task(PerftWorker* worker, PerftTask* task) {
+        PerftThreadPoolState* state = worker->state;
+        const U32 worker_count = U32(state->workers.size());
+        for (U32 i = 1; i < worker_count; ++i) {
+            PerftWorker* victim = state->workers[(worker->index + i) % worker_count].get();
+            std::lock_guard<std::mutex> lock(victim->mutex);
+            if (victim->tasks_count != 0) {
+                *task = victim->tasks[victim->tasks_begin];
+                victim->tasks_begin = (victim->tasks_begin + 1) % perft_task_capacity;
+                --victim->tasks_count;
+                --state->queued_count;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    static U32 get_task_count(PerftWorker* worker) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        return worker->tasks_count;
+    }
+
+    static PerftSplit* take_split(PerftWorker* worker) {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        PerftSplit* split = worker->free_splits;
+        if (split) {
+            worker->free_splits = split->next_free;
+        }
+        return split;
+    }
+
+    static void give_back_split(PerftSplit* split) {
+        PerftWorker* owner = split->owner;
+        std::lock_guard<std::mutex> lock(owner->mutex);
+        split->next_free = owner->free_splits;
+        owner->free_splits = split;
+    }
+
+    static void add_task_nodes(PerftThreadPoolState* state, PerftTask* task, U64 nodes) {
+        PerftSplit* split = task->split;
+        while (split) {
+            split->nodes += nodes;
+            if (--split->pending_count != 0) {
+                return;
+            }
+
+            nodes = split->nodes;
+            if (state->table) {
+                store_perft_table(state->table, split->key, split->depth, nodes);
+            }
+            PerftSplit* parent = split->parent;
+            give_back_split(split);
+            split = parent;
+        }
+
+        task->result->nodes += nodes;
+    }
+
+    // detailed tasks fill every PerftResult count with perft, the others only count nodes with fast_perft
+    template <Colour colour, bool bulk_count, bool detailed, UndoMode undo_mode = UndoMode::MakeUnmake>
+    static void run_perft_task(PerftWorker* worker, PerftTask task) {
+        PerftThreadPoolState* state = worker->state;
+        Game* game = &worker->game;
+        set_position(game, &task.position);
+
+        // split when some worker has run dry, or when this worker has nothing left for others to steal
+        bool split = false;
+        if (task.depth > perft_min_split_depth) {
+            const U32 task_count = get_task_count(worker);
+            split = (state->idle_count > 0 || task_count == 0) && task_count + move_list_capacity <= perft_task_capacity;
+        }
+
+        if (!split) {
+            if constexpr (detailed) {
+                task.result->add(perft<colour, false>(game, task.depth));
+            } else {
+                add_task_nodes(state, &task, fast_perft<colour, false, bulk_count, undo_mode>(game, task.depth, state->table));
+            }
+            return;
+        }
+
+        if constexpr (!detailed) {
+            U64 nodes;
+            if (state->table && probe_perft_table(state->table, game->key, task.depth, &nodes)) {
+                add_task_nodes(state, &task, nodes);
+                return;
+            }
+        }
+
+        MoveList move_list;
+        generate_legal_moves<colour>(game, &move_list);
+
+        PerftSplit* split_node = nullptr;
+        if constexpr (!detailed) {
+            if (move_list.count == 0) {
+                add_task_nodes(state, &task, 0);
+                return;
+            }
+
+            split_node = take_split(worker);
+            if (!split_node) {
+                add_task_nodes(state, &task, fast_perft<colour, false, bulk_count, undo_mode>(game, task.depth, state->table));
+                return;
+            }
+
+            split_node->key = game->key;
+            split_node->depth = task.depth;
+            split_node->parent = task.split;
+            split_node->nodes.store(0, std::memory_order_relaxed);
+            split_node->pending_count.store(move_list.count, std::memory_order_relaxed);
+        }
+
+        PerftTask children[move_list_capacity];
+        for (U16 i = 0; i < move_list.count; ++i) {
+            move_unchecked<colour>(game, move_list.moves[i]);
+            children[i] = PerftTask{get_position(game), U8(task.depth - 1), task.result, split_node, run_perft_task<EnemyColour<colour>::colour, bulk_count, detailed, undo_mode>};
+            undo_unchecked<colour, undo_mode>(game, &task.position);
+        }
+
+        // counted before this task finishes, so that pending_count can not reach 0 while the children are still to run
+        state->pending_count += move_list.count;
+        push_tasks(worker, children, move_list.count);
+    }
+
+    static void perft_worker_loop(PerftWorker* worker) {
+        PerftThreadPoolState* state = worker->state;
+        for (;;) {
+            PerftTask task;
+            if (pop_task(worker, &task) || steal_task(worker, &task)) {
+                task.run(worker, task);
+                if (--state->pending_count == 0) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->job_done.notify_all();
                 }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(state->mutex);
+            ++state->idle_count;
+            state->work_available.wait(lock, [state]() { return state->stop || state->queued_count > 0; });
+            --state->idle_count;
+            if (state->stop) {
+                return;
+            }
+        }
+    }
+
+    PerftThreadPool::PerftThreadPool(U32 in_thread_count)
+        : thread_count(in_thread_count ? in_thread_count : std::max(1U, std::thread::hardware_concurrency()))
+        , state(new PerftThreadPoolState)
+    {
+        for (U32 i = 0; i < thread_count; ++i) {
+            state->workers.push_back(std::make_unique<PerftWorker>());
+            state->workers[i]->state = state;
+            state->workers[i]->index = i;
+            state->workers[i]->tasks_begin = 0;
+            state->workers[i]->tasks_count = 0;
+            state->workers[i]->free_splits = nullptr;
+            for (U32 j = 0; j < perft_split_capacity; ++j) {
+                PerftSplit* split = &state->workers[i]->splits[j];
+                split->owner = state->workers[i].get();
+                split->next_free = state->workers[i]->free_splits;
+                state->workers[i]->free_splits = split;
+            }
+        }
+
+        // started once every worker exists, as they steal from each other
+        for (U32 i = 0; i < thread_count; ++i) {
+            state->workers[i]->thread = std::thread(perft_worker_loop, state->workers[i].get());
+        }
+    }
+
+    PerftThreadPool::~PerftThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->stop = true;
+            state->work_available.notify_all();
+        }
+
+        for (U32 i = 0; i < thread_count; ++i) {
+            state->workers[i]->thread.join();
+        }
+
+        delete state;
+    }
+    // #endregion
+
+    static PerftThreadPool* get_default_perft_thread_pool() {
+        static PerftThreadPool default_pool;
+        return &default_pool;
+    }
+
+    // splits the root moves between the workers of pool, depth must be greater than perft_min_split_depth
+    template <Colour colour, bool divided, bool bulk_count, bool detailed, UndoMode undo_mode = UndoMode::MakeUnmake>
+    static PerftResult run_perft_on_pool(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool) {
+        CHESS_ASSERT(depth > perft_min_split_depth);
+        PerftThreadPoolState* state = pool->state;
+        std::lock_guard<std::mutex> job_lock(state->job_mutex);
+        state->table = table;
+
+        MoveList move_list;
+        generate_legal_moves<colour>(game, &move_list);
+
+        Position position;
+        if constexpr (undo_mode == UndoMode::CopyMake) {
+            position = get_position(game);
+        }
+
+        PerftTaskResult results[move_list_capacity]{};
+        state->pending_count = move_list.count;
+        for (U16 i = 0; i < move_list.count; ++i) {
+            move_unchecked<colour>(game, move_list.moves[i]);
+            const PerftTask task{get_position(game), U8(depth - 1), &results[i], nullptr, run_perft_task<EnemyColour<colour>::colour, bulk_count, detailed, undo_mode>};
+            undo_unchecked<colour, undo_mode>(game, &position);
+            push_tasks(state->workers[i % pool->thread_count].get(), &task, 1);
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(state->mutex);
+            state->job_done.wait(lock, [state]() { return state->pending_count == 0; });
+        }
+
+        PerftResult result{};
+        for (U16 i = 0; i < move_list.count; ++i) {
+            const PerftResult move_result = results[i].get();
+            if constexpr (divided) {
+                char move_name[6];
+                string_move(move_list.moves[i], move_name);
+                std::cout << move_name << ": " << move_result.nodes << std::endl;
             }
+            result = result + move_result;
         }
 
         return result;
     }
 
+    template <bool divided, bool bulk_count, UndoMode undo_mode>
+    U64 fast_perft_multi_threaded(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool) {
+        if (depth <= perft_min_split_depth) {
+            return fast_perft<divided, bulk_count, undo_mode>(game, depth, table);
+        }
+
+        if (!pool) {
+            pool = get_default_perft_thread_pool();
+        }
+
+        if (game->next_turn) {
+            return run_perft_on_pool<Colour::Black, divided, bulk_count, false, undo_mode>(game, depth, table, pool).nodes;
+        }
+
+        return run_perft_on_pool<Colour::White, divided, bulk_count, false, undo_mode>(game, depth, table, pool).nodes;
+    }
+
+    template U64 fast_perft_multi_threaded<false, false, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<false, true, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<true, false, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<true, true, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<false, false, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<false, true, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<true, false, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+    template U64 fast_perft_multi_threaded<true, true, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table, PerftThreadPool* pool);
+
+    template <bool divided, bool bulk_count, UndoMode undo_mode>
+    U64 fast_perft(Game* game, U8 depth, PerftTable* table) {
+        if (depth == 0) {
+            return 1;
+        }
+
+        if (game->next_turn) {
+            return fast_perft<Colour::Black, divided, bulk_count, undo_mode>(game, depth, table);
+        }
+
+        return fast_perft<Colour::White, divided, bulk_count, undo_mode>(game, depth, table);
+    }
+
+    template U64 fast_perft<false, false, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<false, true, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<true, false, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<true, true, UndoMode::MakeUnmake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<false, false, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<false, true, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<true, false, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table);
+    template U64 fast_perft<true, true, UndoMode::CopyMake>(Game* game, U8 depth, PerftTable* table);
+
     template <bool divided>
     PerftResult perft(Game* game, U8 depth) {
         if (game->next_turn) {
@@ -2179,14 +2782,34 @@ namespace chess { namespace engine {
 
     template PerftResult perft<false>(Game* game, U8 depth);
     template PerftResult perft<true>(Game* game, U8 depth);
+
+    template <bool divided>
+    PerftResult perft_multi_threaded(Game* game, U8 depth, PerftThreadPool* pool) {
+        if (depth <= perft_min_split_depth) {
+            return perft<divided>(game, depth);
+        }
+
+        if (!pool) {
+            pool = get_default_perft_thread_pool();
+        }
+
+        if (game->next_turn) {
+            return run_perft_on_pool<Colour::Black, divided, false, true>(game, depth, nullptr, pool);
+        }
+
+        return run_perft_on_pool<Colour::White, divided, false, true>(game, depth, nullptr, pool);
+    }
+
+    template PerftResult perft_multi_threaded<false>(Game* game, U8 depth, PerftThreadPool* pool);
+    template PerftResult perft_multi_threaded<true>(Game* game, U8 depth, PerftThreadPool* pool);
     // #endregion
 
     void string_move(Move move, char* buffer) {
-        char from_rank = '1' + (U8(move.from) / chess_board_edge_size);
-        char from_file = 'a' + (U8(move.from) % chess_board_edge_size);
-        char to_rank = '1' + (U8(move.to) / chess_board_edge_size);
-        char to_file = 'a' + (U8(move.to) % chess_board_edge_size);
-        const Piece::Type promotion_piece_type = get_promotion_piece_type(move.compressed_taken_and_promotion_piece_type);
+        char from_rank = '1' + (U8(get_from(move)) / chess_board_edge_size);
+        char from_file = 'a' + (U8(get_from(move)) % chess_board_edge_size);
+        char to_rank = '1' + (U8(get_to(move)) / chess_board_edge_size);
+        char to_file = 'a' + (U8(get_to(move)) % chess_board_edge_size);
+        const Piece::Type promotion_piece_type = get_promotion_piece_type(move);
         if (promotion_piece_type == Piece::Type::Empty) {
             snprintf(buffer, 6, "%c%c%c%c", from_file, from_rank, to_file, to_rank);
         } else {
@@ -2359,11 +2982,47 @@ namespace chess { namespace engine {
     }
 
     Game* copy(Game* game) {
-        Game* result = static_cast<Game*>(malloc(sizeof(Game)));
+        Game* result = static_cast<Game*>(aligned_alloc(alignof(Game), sizeof(Game)));
         memcpy(result, game, sizeof(Game));
-        result->moves = static_cast<Move*>(malloc(sizeof(Move) * result->moves_allocated));
-        result->moves_count = 0;
-        result->moves_index = 0;
+        result->cold = new ColdState;
+        result->cold->cache = game->cold->cache;
+        result->cold->moves_allocated = game->cold->moves_allocated;
+        result->cold->moves = static_cast<Move*>(malloc(sizeof(Move) * result->cold->moves_allocated));
+        result->cold->plies = static_cast<PlyState*>(malloc(sizeof(PlyState) * result->cold->moves_allocated));
+        result->cold->plies[0] = game->cold->plies[game->cold->moves_index];
+        result->cold->moves_count = 0;
+        result->cold->moves_index = 0;
+        return result;
+    }
+
+    Position get_position(const Game* game) {
+        Position result;
+        memcpy(result.pieces, game->pieces, sizeof(result.pieces));
+        result.key = game->key;
+        result.en_passant_cell = game->en_passant_cell;
+        result.can_en_passant = game->can_en_passant;
+        result.next_turn = game->next_turn;
+        result.white_can_never_castle_short = game->white_can_never_castle_short;
+        result.white_can_never_castle_long = game->white_can_never_castle_long;
+        result.black_can_never_castle_short = game->black_can_never_castle_short;
+        result.black_can_never_castle_long = game->black_can_never_castle_long;
         return result;
     }
+
+    void set_position(Game* game, const Position* position) {
+        copy_position(game, position);
+        CHESS_ASSERT(game->key == calculate_key(game));
+
+        game->cold->moves_count = 0;
+        game->cold->moves_index = 0;
+        game->cold->plies[0].key = game->key;
+
+        if (game->next_turn) {
+            update_cache<Colour::Black>(game);
+            calculate_check_data<Colour::Black>(game);
+        } else {
+            update_cache<Colour::White>(game);
+            calculate_check_data<Colour::White>(game);
+        }
+    }
 }}
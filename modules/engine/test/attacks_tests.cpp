@@ -0,0 +1,100 @@
+
+#include "generators.hpp"
+#include <chess/engine/engine.hpp>
+#include <chess/engine/attacks.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+#include <catch2/generators/catch_generators_range.hpp>
+#include <catch2/generators/catch_generators_adapters.hpp>
+
+namespace chess { namespace engine {
+    static Bitboard slide_in_directions(Bitboard::Index index, Bitboard occupancy, Direction a, Direction b, Direction c, Direction d) {
+        const Bitboard bitboard(index);
+        return slide_in_direction(bitboard, a, occupancy) | slide_in_direction(bitboard, b, occupancy)
+            | slide_in_direction(bitboard, c, occupancy) | slide_in_direction(bitboard, d, occupancy);
+    }
+
+    TEST_CASE("sliding attacks", "[attacks]") {
+        const SliderBackend backend = GENERATE(SliderBackend::Loop, SliderBackend::Magic, SliderBackend::Pext);
+        const Bitboard::Index index = GENERATE(bitboard_index_range(Bitboard::Index(0), Bitboard::Index(chess_board_size)));
+        const SliderBackend previous_backend = get_slider_backend();
+        if (!set_slider_backend(backend)) {
+            return;
+        }
+
+        const U64 occupancies[]{
+            0,
+            0xFFFF00000000FFFFULL,
+            0x0000FFFFFFFF0000ULL,
+            0x55AA55AA55AA55AAULL,
+            0x0123456789ABCDEFULL,
+            0xFEDCBA9876543210ULL,
+            0x8100000000000081ULL,
+            ~0ULL
+        };
+
+        for (const U64 occupancy : occupancies) {
+            CHECK(get_bishop_attacks(index, Bitboard(occupancy)) == slide_in_directions(index, Bitboard(occupancy), Direction::NorthEast, Direction::SouthEast, Direction::SouthWest, Direction::NorthWest));
+            CHECK(get_rook_attacks(index, Bitboard(occupancy)) == slide_in_directions(index, Bitboard(occupancy), Direction::North, Direction::East, Direction::South, Direction::West));
+        }
+
+        set_slider_backend(previous_backend);
+    }
+
+    TEST_CASE("knight, king and pawn attacks", "[attacks]") {
+        const Bitboard::Index index = GENERATE(bitboard_index_range(Bitboard::Index(0), Bitboard::Index(chess_board_size)));
+        const Bitboard bitboard(index);
+
+        CHECK(get_knight_attacks(index) == get_knight_attacks(bitboard));
+        CHECK(get_king_attacks(index) == get_king_attacks(bitboard));
+        CHECK(get_pawn_attacks<Colour::White>(index) == get_pawn_attacks<Colour::White>(bitboard));
+        CHECK(get_pawn_attacks<Colour::Black>(index) == get_pawn_attacks<Colour::Black>(bitboard));
+
+        static_assert(get_knight_attacks(Bitboard::Index(File::A, Rank::One)) == (Bitboard(File::B, Rank::Three) | Bitboard(File::C, Rank::Two)));
+        static_assert(get_king_attacks(Bitboard::Index(File::H, Rank::Eight)) == (Bitboard(File::G, Rank::Eight) | Bitboard(File::G, Rank::Seven) | Bitboard(File::H, Rank::Seven)));
+        static_assert(get_pawn_attacks<Colour::White>(Bitboard::Index(File::A, Rank::Two)) == Bitboard(File::B, Rank::Three));
+        static_assert(get_pawn_attacks<Colour::Black>(Bitboard::Index(File::H, Rank::Seven)) == Bitboard(File::G, Rank::Six));
+    }
+
+    TEST_CASE("line and between", "[attacks]") {
+        const Bitboard::Index a1(File::A, Rank::One);
+        const Bitboard::Index c3(File::C, Rank::Three);
+        const Bitboard::Index h8(File::H, Rank::Eight);
+        const Bitboard::Index b3(File::B, Rank::Three);
+
+        CHECK(get_between(a1, h8) == (get_ray(a1, Direction::NorthEast) & ~Bitboard(h8)));
+        CHECK(get_between(h8, a1) == get_between(a1, h8));
+        CHECK(get_between(a1, c3) == Bitboard(File::B, Rank::Two));
+        CHECK(get_between(a1, b3) == Bitboard());
+        CHECK(get_line(c3, a1) == (get_ray(a1, Direction::NorthEast) | Bitboard(a1)));
+        CHECK(get_line(a1, b3) == Bitboard());
+        CHECK(get_line(c3, b3) == bitboard_rank[U8(Rank::Three)]);
+    }
+
+    TEST_CASE("perft slider backends", "[attacks][perft]") {
+        const SliderBackend backend = GENERATE(SliderBackend::Loop, SliderBackend::Magic, SliderBackend::Pext);
+        const SliderBackend previous_backend = get_slider_backend();
+        if (!set_slider_backend(backend)) {
+            return;
+        }
+
+        SECTION("initial position") {
+            Game game;
+            CHECK(fast_perft(&game, 4) == 197281);
+        }
+
+        SECTION("position 2") {
+            Game game;
+            CHECK(load_fen(&game, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - "));
+            CHECK(fast_perft(&game, 3) == 97862);
+        }
+
+        SECTION("position 3") {
+            Game game;
+            CHECK(load_fen(&game, "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - "));
+            CHECK(fast_perft(&game, 5) == 674624);
+        }
+
+        set_slider_backend(previous_backend);
+    }
+}}
@@ -2,4 +2,6 @@
 #include "bitboard_tests.cpp"
 #include "file_tests.cpp"
 #include "rank_tests.cpp"
+#include "attacks_tests.cpp"
+#include "zobrist_tests.cpp"
 #include "perft_tests.cpp"
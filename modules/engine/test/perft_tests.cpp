@@ -331,6 +331,410 @@ namespace chess { namespace engine {
         450410
     };
 
+    TEST_CASE("generate legal moves", "[perft][moves]") {
+        Game game;
+        MoveList move_list;
+
+        SECTION("initial position") {
+            generate_legal_moves(&game, &move_list);
+            CHECK(move_list.count == start_position_nodes[1]);
+        }
+
+        SECTION("promotions are expanded") {
+            CHECK(load_fen(&game, "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - "));
+            generate_legal_moves(&game, &move_list);
+            CHECK(move_list.count == 44);
+
+            U16 promotions = 0;
+            for (U16 i = 0; i < move_list.count; ++i) {
+                if (get_promotion_piece_type(move_list.moves[i]) != Piece::Type::Empty) {
+                    CHECK(get_from(move_list.moves[i]) == Bitboard::Index(File::D, Rank::Seven));
+                    ++promotions;
+                }
+            }
+            CHECK(promotions == 4);
+        }
+
+        SECTION("en passant and castling are flagged") {
+            CHECK(load_fen(&game, "r3k2r/8/8/3pP3/8/8/8/R3K2R w KQkq d6 "));
+            generate_legal_moves(&game, &move_list);
+
+            U16 en_passant = 0;
+            U16 castles = 0;
+            for (U16 i = 0; i < move_list.count; ++i) {
+                const Move the_move = move_list.moves[i];
+                if (get_flag(the_move) == Move::Flag::EnPassant) {
+                    CHECK(get_to(the_move) == Bitboard::Index(File::D, Rank::Six));
+                    ++en_passant;
+                } else if (get_flag(the_move) == Move::Flag::Castle) {
+                    CHECK(get_from(the_move) == Bitboard::Index(File::E, Rank::One));
+                    ++castles;
+                }
+            }
+            CHECK(en_passant == 1);
+            CHECK(castles == 2);
+            CHECK(sizeof(Move) == 2);
+        }
+
+        SECTION("en passant legality") {
+            struct {
+                const char* fen;
+                U16 en_passant;
+            } cases[] = {
+                // both pawns leave the king's rank
+                { "8/8/8/K2pP2r/8/8/8/7k w - d6 ", 0 },
+                { "8/8/8/8/R2Pp2k/8/8/K7 b - d3 ", 0 },
+                { "8/8/8/K1npP2r/8/8/8/7k w - d6 ", 1 },
+                // the taking pawn is pinned, along the file and along the diagonal it takes on
+                { "4r2k/8/8/3pP3/8/8/8/4K3 w - d6 ", 0 },
+                { "1b5k/8/8/3pP3/8/8/7K/8 w - d6 ", 1 },
+                // in check, from the pawn that is taken and from a rook
+                { "7k/8/8/3pP3/4K3/8/8/8 w - d6 ", 1 },
+                { "7k/8/8/3pP3/8/8/8/r3K3 w - d6 ", 0 }
+            };
+
+            for (const auto& c : cases) {
+                CHECK(load_fen(&game, c.fen));
+                generate_legal_moves(&game, &move_list);
+                U16 en_passant = 0;
+                for (U16 i = 0; i < move_list.count; ++i) {
+                    if (get_flag(move_list.moves[i]) == Move::Flag::EnPassant) {
+                        ++en_passant;
+                    }
+                }
+                CHECK(en_passant == c.en_passant);
+            }
+        }
+    }
+
+    TEST_CASE("bulk counting", "[perft][bulk]") {
+        Game game;
+
+        SECTION("initial position") {
+            CHECK(fast_perft<false, true>(&game, 5) == start_position_nodes[5]);
+        }
+
+        SECTION("position 2") {
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft<false, true>(&game, 4) == position_2_nodes[4]);
+        }
+
+        SECTION("position 3") {
+            CHECK(load_fen(&game, position_3_fen));
+            CHECK(fast_perft<false, true>(&game, 6) == position_3_nodes[6]);
+        }
+    }
+
+    TEST_CASE("hashed perft", "[perft][hash]") {
+        Game game;
+        // small enough that entries get replaced
+        PerftTable table(1);
+
+        SECTION("initial position") {
+            CHECK(fast_perft<false, true>(&game, 5, &table) == start_position_nodes[5]);
+            // the second run is answered from the table
+            CHECK(fast_perft<false, true>(&game, 5, &table) == start_position_nodes[5]);
+            CHECK(fast_perft<false, false>(&game, 4, &table) == start_position_nodes[4]);
+        }
+
+        SECTION("position 2") {
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft<false, true>(&game, 4, &table) == position_2_nodes[4]);
+        }
+
+        SECTION("position 3") {
+            CHECK(load_fen(&game, position_3_fen));
+            CHECK(fast_perft<false, true>(&game, 6, &table) == position_3_nodes[6]);
+        }
+
+        SECTION("shared between threads") {
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 5, &table) == start_position_nodes[5]);
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 4, &table) == position_2_nodes[4]);
+        }
+    }
+
+    TEST_CASE("load fen", "[perft][fen]") {
+        Game game;
+
+        SECTION("move counters and trailing space are optional") {
+            CHECK(load_fen(&game, "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"));
+            CHECK(fast_perft(&game, 2) == position_2_nodes[2]);
+            CHECK(load_fen(&game, "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -"));
+            CHECK(fast_perft(&game, 2) == position_3_nodes[2]);
+            CHECK_FALSE(load_fen(&game, "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - x"));
+        }
+
+        SECTION("en passant") {
+            Game other;
+            CHECK(make_moves(&other, "e2e4 a7a6 e4e5 d7d5"));
+            CHECK(load_fen(&game, "rnbqkbnr/1pp1pppp/p7/3pP3/8/8/PPPP1PPP/RNBQKBNR w KQkq d6 0 3"));
+            CHECK(game.key == other.key);
+            CHECK(fast_perft(&game, 1) == 31);
+            CHECK(fast_perft(&game, 3) == fast_perft(&other, 3));
+        }
+    }
+
+    TEST_CASE("set position", "[perft][position]") {
+        Game game;
+        // white can take en passant after d5, which undo has to restore without the moves that led here
+        CHECK(make_moves(&game, "e2e4 a7a6 e4e5 d7d5"));
+        const Position position = get_position(&game);
+
+        Game other;
+        CHECK(make_moves(&other, "g1f3 g8f6"));
+        set_position(&other, &position);
+        CHECK(other.key == game.key);
+        CHECK(other.cold->moves_index == 0);
+        CHECK(fast_perft<false, false>(&other, 4) == fast_perft<false, false>(&game, 4));
+    }
+
+    static void check_occupancy(const Game* game) {
+        for (U8 colour = 0; colour < 2; ++colour) {
+            Bitboard expected;
+            for (U8 type = 0; type < piece_type_count; ++type) {
+                expected |= game->pieces[colour][type];
+            }
+            CHECK(game->colour_pieces[colour] == expected);
+        }
+        CHECK(get_all_pieces(game) == (game->colour_pieces[U8(Colour::White)] | game->colour_pieces[U8(Colour::Black)]));
+    }
+
+    TEST_CASE("occupancy", "[perft][position]") {
+        Game game;
+        check_occupancy(&game);
+
+        // a capture, en passant, castling and a promotion with capture
+        CHECK(make_moves(&game, "e2e4 d7d5 e4d5 c7c5 d5c6 g8f6 g1f3 e7e6 f1e2 f8e7 e1g1 e8g8 c6b7 a7a6 b7a8q"));
+        check_occupancy(&game);
+        while (undo(&game)) {
+            check_occupancy(&game);
+        }
+        CHECK(game.key == Game().key);
+
+        CHECK(load_fen(&game, position_2_fen));
+        check_occupancy(&game);
+    }
+
+    // the stored check data of game against that of a fresh game with the same position
+    static void check_ply_state(const Game* game) {
+        const Position position = get_position(game);
+        Game fresh;
+        set_position(&fresh, &position);
+        const CheckData* check_data = get_check_data(game);
+        const CheckData* expected = get_check_data(&fresh);
+        CHECK(check_data->pinned == expected->pinned);
+        CHECK(check_data->enemy_attacks == expected->enemy_attacks);
+        CHECK(check_data->check_resolution_bitboard == expected->check_resolution_bitboard);
+        CHECK(check_data->single_check == expected->single_check);
+        CHECK(check_data->double_check == expected->double_check);
+        CHECK(check_data->has_moves == expected->has_moves);
+        CHECK(game->cold->plies[game->cold->moves_index].key == game->key);
+    }
+
+    TEST_CASE("ply states", "[perft][position]") {
+        Game game;
+        CHECK(load_fen(&game, position_2_fen));
+        check_ply_state(&game);
+
+        // longer than the history first allocated, so it has to grow
+        MoveList move_list;
+        const U64 moves_allocated = game.cold->moves_allocated;
+        for (U32 ply = 0; ply < moves_allocated + 8; ++ply) {
+            generate_legal_moves(&game, &move_list);
+            if (move_list.count == 0) {
+                break;
+            }
+
+            const Move the_move = move_list.moves[(ply * 7) % move_list.count];
+            if (get_flag(the_move) == Move::Flag::Promotion) {
+                CHECK(move_and_promote(&game, get_from(the_move), get_to(the_move), get_promotion_piece_type(the_move)));
+            } else {
+                CHECK(move(&game, get_from(the_move), get_to(the_move)));
+            }
+        }
+        CHECK(game.cold->moves_count > 16);
+
+        while (undo(&game)) {
+            check_ply_state(&game);
+        }
+        while (redo(&game)) {
+            check_ply_state(&game);
+        }
+    }
+
+    TEST_CASE("copy-make perft", "[perft][copy]") {
+        Game game;
+
+        SECTION("initial position") {
+            CHECK(fast_perft<false, false, UndoMode::CopyMake>(&game, 4) == start_position_nodes[4]);
+            CHECK(fast_perft<false, true, UndoMode::CopyMake>(&game, 5) == start_position_nodes[5]);
+        }
+
+        SECTION("position 2") {
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft<false, true, UndoMode::CopyMake>(&game, 4) == position_2_nodes[4]);
+            // the game is left as it was
+            CHECK(fast_perft<false, false>(&game, 3) == position_2_nodes[3]);
+        }
+
+        SECTION("position 3") {
+            CHECK(load_fen(&game, position_3_fen));
+            CHECK(fast_perft<false, true, UndoMode::CopyMake>(&game, 6) == position_3_nodes[6]);
+        }
+
+        SECTION("multi-threaded") {
+            PerftThreadPool pool(3);
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft_multi_threaded<false, true, UndoMode::CopyMake>(&game, 4, nullptr, &pool) == position_2_nodes[4]);
+        }
+    }
+
+    TEST_CASE("gives check", "[perft][check]") {
+        Game game;
+        const char* fen = GENERATE(
+            as<const char*>{},
+            position_2_fen,
+            position_3_fen,
+            // promotions, with and without discovering a check
+            "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - ",
+            "8/3P4/8/8/1k6/8/8/3RK3 w - - ",
+            // en passant that uncovers a check along the rank and along a diagonal
+            "8/8/8/k2pP2R/8/8/8/4K3 w - d6 ",
+            "8/8/6k1/3pP3/8/8/B7/4K3 w - d6 ",
+            // castling where the rook gives check
+            "5k2/8/8/8/8/8/8/R3K2R w KQ - ",
+            "3k4/8/8/8/8/8/8/R3K2R w KQ - "
+        );
+        CHECK(load_fen(&game, fen));
+
+        MoveList move_list;
+        generate_legal_moves(&game, &move_list);
+        const CheckSquares check_squares = get_check_squares(&game);
+        for (U16 i = 0; i < move_list.count; ++i) {
+            const Move the_move = move_list.moves[i];
+            const bool expected_check = gives_check(&game, &check_squares, the_move);
+            CHECK(gives_check(&game, the_move) == expected_check);
+
+            if (get_flag(the_move) == Move::Flag::Promotion) {
+                CHECK(move_and_promote(&game, get_from(the_move), get_to(the_move), get_promotion_piece_type(the_move)));
+            } else {
+                CHECK(move(&game, get_from(the_move), get_to(the_move)));
+            }
+            const CheckData* check_data = get_check_data(&game);
+            CHECK((check_data->single_check || check_data->double_check) == expected_check);
+            CHECK(undo(&game));
+        }
+    }
+
+    // the cached legal moves of game against those of a fresh game with the same position
+    static void check_cache(Game* game) {
+        const Position position = get_position(game);
+        Game fresh;
+        set_position(&fresh, &position);
+        for (U8 i = 0; i < chess_board_size; ++i) {
+            CHECK(get_moves(game, Bitboard::Index(i)) == get_moves(&fresh, Bitboard::Index(i)));
+        }
+    }
+
+    TEST_CASE("incremental cache", "[perft][cache]") {
+        Game game;
+
+        SECTION("en passant") {
+            // the en passant capture on d6 is cached, and has to go once the next moves are made elsewhere
+            CHECK(make_moves(&game, "e2e4 a7a6 e4e5 d7d5"));
+            CHECK(get_moves(&game, Bitboard::Index(File::E, Rank::Five)) & Bitboard(File::D, Rank::Six));
+            CHECK(make_moves(&game, "a2a3 h7h6"));
+            check_cache(&game);
+            CHECK(undo(&game));
+            CHECK(undo(&game));
+            check_cache(&game);
+        }
+
+        SECTION("moves, undo and redo") {
+            const char* fen = GENERATE(
+                as<const char*>{},
+                position_2_fen,
+                position_3_fen,
+                // promotions, checks and castling rights lost by captures
+                "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - ",
+                "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPPPNnPP/RNBQK2R w KQ - "
+            );
+            CHECK(load_fen(&game, fen));
+
+            MoveList move_list;
+            for (U32 ply = 0; ply < 60; ++ply) {
+                check_cache(&game);
+                generate_legal_moves(&game, &move_list);
+                if (move_list.count == 0) {
+                    break;
+                }
+
+                const Move the_move = move_list.moves[(ply * 7) % move_list.count];
+                if (get_flag(the_move) == Move::Flag::Promotion) {
+                    CHECK(move_and_promote(&game, get_from(the_move), get_to(the_move), get_promotion_piece_type(the_move)));
+                } else {
+                    CHECK(move(&game, get_from(the_move), get_to(the_move)));
+                }
+
+                if (ply % 3 == 0) {
+                    check_cache(&game);
+                    CHECK(undo(&game));
+                    check_cache(&game);
+                    CHECK(redo(&game));
+                }
+            }
+        }
+    }
+
+    TEST_CASE("multi-threaded perft", "[perft][threads]") {
+        Game game;
+        const U32 thread_count = GENERATE(1, 3);
+        PerftThreadPool pool(thread_count);
+
+        SECTION("initial position") {
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 5, nullptr, &pool) == start_position_nodes[5]);
+            // the pool is reused between runs
+            CHECK(fast_perft_multi_threaded<false, false>(&game, 4, nullptr, &pool) == start_position_nodes[4]);
+        }
+
+        SECTION("position 2") {
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 4, nullptr, &pool) == position_2_nodes[4]);
+        }
+
+        SECTION("position 3") {
+            CHECK(load_fen(&game, position_3_fen));
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 6, nullptr, &pool) == position_3_nodes[6]);
+        }
+
+        SECTION("hashed") {
+            // split tasks store their totals too, so the second run is also answered from the table at the splits
+            PerftTable table(16);
+            CHECK(load_fen(&game, position_3_fen));
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 6, &table, &pool) == position_3_nodes[6]);
+            CHECK(fast_perft_multi_threaded<false, true>(&game, 6, &table, &pool) == position_3_nodes[6]);
+            CHECK(load_fen(&game, position_2_fen));
+            CHECK(fast_perft_multi_threaded<false, false>(&game, 4, &table, &pool) == position_2_nodes[4]);
+        }
+
+        SECTION("detailed") {
+            CHECK(load_fen(&game, position_2_fen));
+            const PerftResult expected = perft(&game, 4);
+            const PerftResult result = perft_multi_threaded(&game, 4, &pool);
+            CHECK(result.nodes == position_2_nodes[4]);
+            CHECK(result.nodes == expected.nodes);
+            CHECK(result.captures == expected.captures);
+            CHECK(result.en_passant == expected.en_passant);
+            CHECK(result.castles == expected.castles);
+            CHECK(result.promotions == expected.promotions);
+            CHECK(result.checks == expected.checks);
+            CHECK(result.discovery_checks == expected.discovery_checks);
+            CHECK(result.double_checks == expected.double_checks);
+            CHECK(result.checkmates == expected.checkmates);
+        }
+    }
+
     TEST_CASE("perft 1", "[perft][1]") {
         Game game;
         const U64 depth = 1;
@@ -0,0 +1,48 @@
+
+#include <chess/engine/engine.hpp>
+#include <chess/engine/zobrist.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+namespace chess { namespace engine {
+    TEST_CASE("zobrist key", "[zobrist]") {
+        Game game;
+        CHECK(game.key == calculate_key(&game));
+
+        SECTION("transpositions have the same key") {
+            Game other;
+            CHECK(make_moves(&game, "g1f3 g8f6 b1c3 b8c6"));
+            CHECK(make_moves(&other, "b1c3 b8c6 g1f3 g8f6"));
+            CHECK(game.key == other.key);
+            CHECK(game.key == calculate_key(&game));
+        }
+
+        SECTION("side to move changes the key") {
+            Game other;
+            CHECK(make_moves(&game, "g1f3 g8f6 f3g1 f6g8"));
+            CHECK(make_moves(&other, "g1f3"));
+            CHECK(game.key == Game().key);
+            CHECK(game.key != other.key);
+        }
+
+        SECTION("undo restores the key") {
+            const U64 initial_key = game.key;
+            CHECK(make_moves(&game, "e2e4 d7d5 e4d5 e7e5 d5e6"));
+            CHECK(game.key == calculate_key(&game));
+            while (undo(&game)) {
+                CHECK(game.key == calculate_key(&game));
+            }
+            CHECK(game.key == initial_key);
+        }
+
+        SECTION("castling rights and en passant are part of the key") {
+            Game other;
+            CHECK(load_fen(&game, "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - "));
+            CHECK(load_fen(&other, "r3k2r/8/8/8/8/8/8/R3K2R w Kkq - "));
+            CHECK(game.key != other.key);
+
+            CHECK(make_moves(&game, "a1b1 a8b8 b1a1 b8a8"));
+            CHECK(load_fen(&other, "r3k2r/8/8/8/8/8/8/R3K2R w Kk - "));
+            CHECK(game.key == other.key);
+        }
+    }
+}}
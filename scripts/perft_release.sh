@@ -1,2 +1 @@
-
-./build/chess/release/modules/engine/perft/Release/chess_engine_perft "$1" "$2" "$3"
+./build/chess/release/modules/engine/perft/Release/chess_engine_perft "$@"